@@ -32,10 +32,36 @@ typedef std::function<void(const std::string& path, void* context,
                            const SetDataResponse&)>
     SetDataCallback;
 
+typedef std::function<void(const std::string& path, void* context,
+                           const IncrementResponse&)>
+    IncrementCallback;
+
 typedef std::function<void(const std::string& path, void* context,
                            const GetChildrenResponse&)>
     GetChildrenCallback;
 
+typedef std::function<void(const std::string& path, void* context,
+                           const AddWatchResponse&)>
+    AddWatchCallback;
+
+typedef std::function<void(const std::string& path, void* context,
+                           const RemoveWatchResponse&)>
+    RemoveWatchCallback;
+
+// Called for every chunk, until the one with done or an error.
+typedef std::function<void(const std::string& path, void* context,
+                           const GetSubtreeResponse&)>
+    GetSubtreeCallback;
+
+typedef std::function<void(void* context, const StatsResponse&)>
+    StatsCallback;
+
+typedef std::function<void(void* context, const MultiResponse&)>
+    MultiCallback;
+
+typedef std::function<void(void* context, const MultiGetDataResponse&)>
+    MultiGetDataCallback;
+
 }  // namespace saber
 
 #endif  // SABER_CLIENT_CALLBACKS_H_
@@ -6,6 +6,13 @@
 
 namespace saber {
 
-ClientOptions::ClientOptions() : watcher(nullptr), server_manager(nullptr) {}
+ClientOptions::ClientOptions()
+    : watcher(nullptr),
+      server_manager(nullptr),
+      trace_sample_rate(0),
+      notification_coalesce_window(0),
+      enable_read_cache(false),
+      max_chunk_size(0),
+      compress_threshold(0) {}
 
 }  // namespace saber
@@ -5,6 +5,8 @@
 #ifndef SABER_CLIENT_CLIENT_OPTIONS_H_
 #define SABER_CLIENT_CLIENT_OPTIONS_H_
 
+#include <stdint.h>
+
 #include <string>
 
 #include "saber/client/server_manager.h"
@@ -24,6 +26,41 @@ struct ClientOptions {
   // Default: nullptr
   ServerManager* server_manager;
 
+  // The rate of the requests to carry a trace id between [0, 1], the round
+  // trip time of the traced requests is logged at INFO level, and the
+  // server side timestamps can be dumped by GetStats with traces.
+  // Default: 0
+  double trace_sample_rate;
+
+  // The window (in milliseconds) in which the server coalesces the
+  // notifications of the same path and event type into the latest one,
+  // zero means every notification is sent at once.
+  // Default: 0
+  uint32_t notification_coalesce_window;
+
+  // Cache the results of Exists, GetData (without with_data) and
+  // GetChildren, every entry is kept by a watch of the cache and dropped
+  // when it is fired or the session is disconnected. The cache isn't used
+  // while a write of the client is in flight, and the entries of a write
+  // (its path, the children of its parent and, for a Multi, of every op)
+  // are dropped when it is done, so the client reads its own writes even if
+  // the notification is delayed by notification_coalesce_window.
+  // Default: false
+  bool enable_read_cache;
+
+  // Send the data of SetData over it in chunks, and read the data of
+  // GetData in chunks of it, zero means a message carries all the data.
+  // The chunks of a GetData are read again from the start if the node is
+  // changed between them.
+  // Default: 0
+  uint32_t max_chunk_size;
+
+  // Ask the server to compress the data of the messages of at least the
+  // size on the wire in both directions, zero means never. The server may
+  // raise it, see ConnectResponse.compress_threshold.
+  // Default: 0
+  uint32_t compress_threshold;
+
   ClientOptions();
 };
 
@@ -13,13 +13,50 @@ ClientWatchManager::ClientWatchManager(Watcher* watcher) : watcher_(watcher) {}
 ClientWatchManager::~ClientWatchManager() {}
 
 void ClientWatchManager::AddDataWatcher(const std::string& path,
-                                      Watcher* watcher) {
-  data_watches_[path].insert(watcher);
+                                        Watcher* watcher, uint64_t modified_id,
+                                        bool with_data) {
+  Watch& watch = data_watches_[path];
+  watch.watchers.insert(watcher);
+  if (modified_id > watch.id) {
+    watch.id = modified_id;
+  }
+  watch.with_data |= with_data;
 }
 
 void ClientWatchManager::AddChildWatcher(const std::string& path,
-                                       Watcher* watcher) {
-  child_watches_[path].insert(watcher);
+                                         Watcher* watcher,
+                                         uint64_t children_id) {
+  Watch& watch = child_watches_[path];
+  watch.watchers.insert(watcher);
+  if (children_id > watch.id) {
+    watch.id = children_id;
+  }
+}
+
+void ClientWatchManager::AddPersistentWatcher(const std::string& path,
+                                              Watcher* watcher,
+                                              bool recursive,
+                                              bool with_data) {
+  Watch& watch =
+      recursive ? recursive_watches_[path] : persistent_watches_[path];
+  watch.watchers.insert(watcher);
+  watch.with_data |= with_data;
+}
+
+size_t ClientWatchManager::RemovePersistentWatcher(const std::string& path,
+                                                   Watcher* watcher,
+                                                   bool recursive) {
+  auto& watches = recursive ? recursive_watches_ : persistent_watches_;
+  auto it = watches.find(path);
+  if (it == watches.end()) {
+    return 0;
+  }
+  it->second.watchers.erase(watcher);
+  size_t size = it->second.watchers.size();
+  if (size == 0) {
+    watches.erase(it);
+  }
+  return size;
 }
 
 void ClientWatchManager::TriggerWatcher(const WatchedEvent& event) {
@@ -29,15 +66,20 @@ void ClientWatchManager::TriggerWatcher(const WatchedEvent& event) {
       if (watcher_) {
         watchers.insert(watcher_);
       }
-      for (auto& i : data_watches_) {
-        watchers.insert(i.second.begin(), i.second.end());
+      for (auto watches : {&data_watches_, &child_watches_,
+                           &persistent_watches_, &recursive_watches_}) {
+        for (auto& i : *watches) {
+          watchers.insert(i.second.watchers.begin(), i.second.watchers.end());
+        }
       }
-      for (auto& i : child_watches_) {
-        watchers.insert(i.second.begin(), i.second.end());
+      // The watches are re-registered by SetWatches after reconnecting,
+      // but the server has forgotten them if the session is expired.
+      if (event.state() == SS_EXPIRED) {
+        data_watches_.clear();
+        child_watches_.clear();
+        persistent_watches_.clear();
+        recursive_watches_.clear();
       }
-      // FIXME Maybe auto reset watch will be better when state is connected?
-      data_watches_.clear();
-      child_watches_.clear();
       break;
     }
     case ET_NODE_CREATED:
@@ -45,17 +87,28 @@ void ClientWatchManager::TriggerWatcher(const WatchedEvent& event) {
     case ET_NODE_DATA_CHANGED: {
       auto it = data_watches_.find(event.path());
       if (it != data_watches_.end()) {
-        watchers.swap(it->second);
+        watchers.swap(it->second.watchers);
         data_watches_.erase(it);
       }
+      // A deleted node fires its child watches too.
+      if (event.type() == ET_NODE_DELETED) {
+        it = child_watches_.find(event.path());
+        if (it != child_watches_.end()) {
+          watchers.insert(it->second.watchers.begin(),
+                          it->second.watchers.end());
+          child_watches_.erase(it);
+        }
+      }
+      TriggerPersistent(event.path(), true, &watchers);
       break;
     }
     case ET_NODE_CHILDREN_CHANGED: {
       auto it = child_watches_.find(event.path());
       if (it != child_watches_.end()) {
-        watchers.swap(it->second);
+        watchers.swap(it->second.watchers);
         child_watches_.erase(it);
       }
+      TriggerPersistent(event.path(), false, &watchers);
       break;
     }
     default: {
@@ -69,4 +122,63 @@ void ClientWatchManager::TriggerWatcher(const WatchedEvent& event) {
   }
 }
 
+void ClientWatchManager::TriggerPersistent(
+    const std::string& path, bool recursive,
+    std::unordered_set<Watcher*>* watchers) {
+  auto it = persistent_watches_.find(path);
+  if (it != persistent_watches_.end()) {
+    watchers->insert(it->second.watchers.begin(), it->second.watchers.end());
+  }
+  if (!recursive || recursive_watches_.empty()) {
+    return;
+  }
+  // The path and all its ancestors.
+  size_t i = path.size();
+  while (i > 0) {
+    auto j = recursive_watches_.find(path.substr(0, i));
+    if (j != recursive_watches_.end()) {
+      watchers->insert(j->second.watchers.begin(), j->second.watchers.end());
+    }
+    i = path.rfind('/', i - 1);
+    if (i == 0) {
+      auto root = recursive_watches_.find("/");
+      if (root != recursive_watches_.end()) {
+        watchers->insert(root->second.watchers.begin(),
+                         root->second.watchers.end());
+      }
+    } else if (i == std::string::npos) {
+      break;
+    }
+  }
+}
+
+bool ClientWatchManager::GetWatches(SetWatchesRequest* request) const {
+  for (auto& i : data_watches_) {
+    WatchState* state = request->add_data_watches();
+    state->set_path(i.first);
+    state->set_id(i.second.id);
+    state->set_with_data(i.second.with_data);
+  }
+  for (auto& i : child_watches_) {
+    WatchState* state = request->add_child_watches();
+    state->set_path(i.first);
+    state->set_id(i.second.id);
+  }
+  for (auto& i : persistent_watches_) {
+    AddWatchRequest* watch = request->add_persistent_watches();
+    watch->set_path(i.first);
+    watch->set_mode(WM_PERSISTENT);
+    watch->set_with_data(i.second.with_data);
+  }
+  for (auto& i : recursive_watches_) {
+    AddWatchRequest* watch = request->add_persistent_watches();
+    watch->set_path(i.first);
+    watch->set_mode(WM_PERSISTENT_RECURSIVE);
+    watch->set_with_data(i.second.with_data);
+  }
+  return request->data_watches_size() > 0 ||
+         request->child_watches_size() > 0 ||
+         request->persistent_watches_size() > 0;
+}
+
 }  // namespace saber
\ No newline at end of file
@@ -5,10 +5,13 @@
 #ifndef SABER_CLIENT_CLIENT_WATCH_MANAGER_H_
 #define SABER_CLIENT_CLIENT_WATCH_MANAGER_H_
 
+#include <stdint.h>
+
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "saber/proto/saber.pb.h"
 #include "saber/service/watcher.h"
 
 namespace saber {
@@ -18,15 +21,45 @@ class ClientWatchManager {
   explicit ClientWatchManager(Watcher* watcher = nullptr);
   ~ClientWatchManager();
 
-  void AddDataWatcher(const std::string& path, Watcher* watcher);
-  void AddChildWatcher(const std::string& path, Watcher* watcher);
+  // The modified_id is zero if the node doesn't exist.
+  void AddDataWatcher(const std::string& path, Watcher* watcher,
+                      uint64_t modified_id = 0, bool with_data = false);
+  void AddChildWatcher(const std::string& path, Watcher* watcher,
+                       uint64_t children_id = 0);
+
+  void AddPersistentWatcher(const std::string& path, Watcher* watcher,
+                            bool recursive, bool with_data = false);
+  // Return the number of the watchers which still use the watch.
+  size_t RemovePersistentWatcher(const std::string& path, Watcher* watcher,
+                                 bool recursive);
 
+  // The watches are kept when the session is disconnected, and only
+  // cleared when it is expired.
   void TriggerWatcher(const WatchedEvent& event);
 
+  // Fill the watches to re-register after reconnecting,
+  // return false if there is none.
+  bool GetWatches(SetWatchesRequest* request) const;
+
  private:
+  struct Watch {
+    Watch() : id(0), with_data(false) {}
+    std::unordered_set<Watcher*> watchers;
+    // The last modified_id or children_id seen.
+    uint64_t id;
+    bool with_data;
+  };
+
+  typedef std::unordered_map<std::string, Watch> WatchMap;
+
+  void TriggerPersistent(const std::string& path, bool recursive,
+                         std::unordered_set<Watcher*>* watchers);
+
   Watcher* watcher_;
-  std::unordered_map<std::string, std::unordered_set<Watcher*>> data_watches_;
-  std::unordered_map<std::string, std::unordered_set<Watcher*>> child_watches_;
+  WatchMap data_watches_;
+  WatchMap child_watches_;
+  WatchMap persistent_watches_;
+  WatchMap recursive_watches_;
 
   // No copying allowed
   ClientWatchManager(const ClientWatchManager&);
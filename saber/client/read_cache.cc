@@ -0,0 +1,129 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/client/read_cache.h"
+
+namespace saber {
+
+ReadCache::ReadCache() : hits_(0), misses_(0) {}
+
+ReadCache::~ReadCache() {}
+
+void ReadCache::Hit(bool hit) {
+  if (hit) {
+    hits_.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    misses_.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+bool ReadCache::Exists(const std::string& path, ExistsResponse* response) {
+  auto it = data_entries_.find(path);
+  bool hit = (it != data_entries_.end());
+  if (hit) {
+    *response = it->second.exists;
+  }
+  Hit(hit);
+  return hit;
+}
+
+bool ReadCache::GetData(const std::string& path, GetDataResponse* response) {
+  auto it = data_entries_.find(path);
+  bool hit = (it != data_entries_.end() && it->second.has_data);
+  if (hit) {
+    const ExistsResponse& exists = it->second.exists;
+    response->set_code(exists.code());
+    response->set_node_type(exists.node_type());
+    *(response->mutable_stat()) = exists.stat();
+    response->set_data(it->second.data);
+  }
+  Hit(hit);
+  return hit;
+}
+
+bool ReadCache::GetChildren(const std::string& path,
+                            GetChildrenResponse* response) {
+  auto it = children_entries_.find(path);
+  bool hit = (it != children_entries_.end());
+  if (hit) {
+    *response = it->second;
+  }
+  Hit(hit);
+  return hit;
+}
+
+void ReadCache::PutExists(const std::string& path,
+                          const ExistsResponse& response) {
+  DataEntry& entry = data_entries_[path];
+  entry.exists = response;
+}
+
+void ReadCache::PutData(const std::string& path,
+                        const GetDataResponse& response) {
+  DataEntry& entry = data_entries_[path];
+  entry.exists.set_code(response.code());
+  entry.exists.set_node_type(response.node_type());
+  *(entry.exists.mutable_stat()) = response.stat();
+  entry.has_data = true;
+  entry.data = response.data();
+}
+
+void ReadCache::PutChildren(const std::string& path,
+                            const GetChildrenResponse& response) {
+  children_entries_[path] = response;
+}
+
+void ReadCache::Drop(const std::string& path) {
+  size_t found = path.find_last_of('/');
+  if (found != std::string::npos) {
+    children_entries_.erase(path.substr(0, found == 0 ? 1 : found));
+  }
+  data_entries_.erase(path);
+  children_entries_.erase(path);
+  const std::string prefix = path + "/";
+  for (auto it = data_entries_.begin(); it != data_entries_.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = data_entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = children_entries_.begin(); it != children_entries_.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = children_entries_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void ReadCache::Clear() {
+  data_entries_.clear();
+  children_entries_.clear();
+}
+
+void ReadCache::Process(const WatchedEvent& event) {
+  switch (event.type()) {
+    case ET_NONE:
+      if (event.state() != SS_CONNECTED) {
+        Clear();
+      }
+      break;
+    case ET_NODE_CREATED:
+    case ET_NODE_DATA_CHANGED:
+      data_entries_.erase(event.path());
+      break;
+    case ET_NODE_DELETED:
+      data_entries_.erase(event.path());
+      children_entries_.erase(event.path());
+      break;
+    case ET_NODE_CHILDREN_CHANGED:
+      children_entries_.erase(event.path());
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace saber
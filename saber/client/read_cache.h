@@ -0,0 +1,76 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_CLIENT_READ_CACHE_H_
+#define SABER_CLIENT_READ_CACHE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <unordered_map>
+
+#include "saber/proto/saber.pb.h"
+#include "saber/service/watcher.h"
+
+namespace saber {
+
+// The cache of the reads of SaberClient. An entry is filled by a read which
+// also arms the watch of the cache, and is served locally until the watch
+// is fired. It is only used in the loop of the client, except the counters.
+class ReadCache : public Watcher {
+ public:
+  ReadCache();
+  virtual ~ReadCache();
+
+  // Return false if it misses.
+  bool Exists(const std::string& path, ExistsResponse* response);
+  bool GetData(const std::string& path, GetDataResponse* response);
+  bool GetChildren(const std::string& path, GetChildrenResponse* response);
+
+  // The response is RC_OK or RC_NO_NODE (only Exists).
+  void PutExists(const std::string& path, const ExistsResponse& response);
+  void PutData(const std::string& path, const GetDataResponse& response);
+  void PutChildren(const std::string& path,
+                   const GetChildrenResponse& response);
+
+  // Drop the entries a write of the path may change: the node, its
+  // descendants (a recursive delete) and the children of its parent. Used
+  // when a write of the client is done, since the notification of the write
+  // may come later than its response.
+  void Drop(const std::string& path);
+
+  // Drop all the entries, such as when the session is disconnected.
+  void Clear();
+
+  // Invalidate the entries of the event.
+  virtual void Process(const WatchedEvent& event);
+
+  uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+  uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+
+ private:
+  struct DataEntry {
+    DataEntry() : has_data(false) {}
+    ExistsResponse exists;
+    // False if it is only filled by Exists.
+    bool has_data;
+    std::string data;
+  };
+
+  void Hit(bool hit);
+
+  std::unordered_map<std::string, DataEntry> data_entries_;
+  std::unordered_map<std::string, GetChildrenResponse> children_entries_;
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+
+  // No copying allowed
+  ReadCache(const ReadCache&);
+  void operator=(const ReadCache&);
+};
+
+}  // namespace saber
+
+#endif  // SABER_CLIENT_READ_CACHE_H_
@@ -60,9 +60,53 @@ bool Saber::SetData(const SetDataRequest& request, void* context,
   return client_->SetData(request, context, cb);
 }
 
+bool Saber::Increment(const IncrementRequest& request, void* context,
+                      const IncrementCallback& cb) {
+  return client_->Increment(request, context, cb);
+}
+
 bool Saber::GetChildren(const GetChildrenRequest& request, Watcher* watcher,
                         void* context, const GetChildrenCallback& cb) {
   return client_->GetChildren(request, watcher, context, cb);
 }
 
+bool Saber::AddWatch(const AddWatchRequest& request, Watcher* watcher,
+                     void* context, const AddWatchCallback& cb) {
+  return client_->AddWatch(request, watcher, context, cb);
+}
+
+bool Saber::RemoveWatch(const RemoveWatchRequest& request, Watcher* watcher,
+                        void* context, const RemoveWatchCallback& cb) {
+  return client_->RemoveWatch(request, watcher, context, cb);
+}
+
+bool Saber::GetStats(const StatsRequest& request, void* context,
+                     const StatsCallback& cb) {
+  return client_->GetStats(request, context, cb);
+}
+
+bool Saber::GetSubtree(const GetSubtreeRequest& request, void* context,
+                       const GetSubtreeCallback& cb) {
+  return client_->GetSubtree(request, context, cb);
+}
+
+bool Saber::MultiGetData(const MultiGetDataRequest& request, Watcher* watcher,
+                         void* context, const MultiGetDataCallback& cb) {
+  return client_->MultiGetData(request, watcher, context, cb);
+}
+
+bool Saber::Multi(const MultiRequest& request, void* context,
+                  const MultiCallback& cb) {
+  return client_->Multi(request, context, cb);
+}
+
+void Saber::GetCacheStats(uint64_t* hits, uint64_t* misses) const {
+  client_->GetCacheStats(hits, misses);
+}
+
+void Saber::GetWireStats(uint64_t* raw_bytes, uint64_t* wire_bytes,
+                         uint64_t* codec_micros) const {
+  client_->GetWireStats(raw_bytes, wire_bytes, codec_micros);
+}
+
 }  // namespace saber
@@ -40,9 +40,49 @@ class Saber {
   bool SetData(const SetDataRequest& request, void* context,
                const SetDataCallback& cb);
 
+  bool Increment(const IncrementRequest& request, void* context,
+                 const IncrementCallback& cb);
+
   bool GetChildren(const GetChildrenRequest& request, Watcher* watcher,
                    void* context, const GetChildrenCallback& cb);
 
+  // Read a whole subtree in chunks, the next chunk is requested after the
+  // callback of the last one returns.
+  bool GetSubtree(const GetSubtreeRequest& request, void* context,
+                  const GetSubtreeCallback& cb);
+
+  // Read many nodes in one round trip, the watcher is set for the requests
+  // with watch.
+  bool MultiGetData(const MultiGetDataRequest& request, Watcher* watcher,
+                    void* context, const MultiGetDataCallback& cb);
+
+  // All or nothing, see MultiRequest.
+  bool Multi(const MultiRequest& request, void* context,
+             const MultiCallback& cb);
+
+  // Add a persistent or recursive watch, it stays registered until it is
+  // removed by RemoveWatch.
+  bool AddWatch(const AddWatchRequest& request, Watcher* watcher,
+                void* context, const AddWatchCallback& cb);
+
+  bool RemoveWatch(const RemoveWatchRequest& request, Watcher* watcher,
+                   void* context, const RemoveWatchCallback& cb);
+
+  // Get the live state of the connected server, it doesn't need the session,
+  // and isn't resent on reconnect, it fails with RC_UNKNOWN when the
+  // connection is closed, and with RC_FAILED unless the server enables it
+  // (ServerOptions::enable_stats).
+  bool GetStats(const StatsRequest& request, void* context,
+                const StatsCallback& cb);
+
+  // The counters of the read cache, see ClientOptions::enable_read_cache.
+  void GetCacheStats(uint64_t* hits, uint64_t* misses) const;
+
+  // The counters of the wire compression, see
+  // ClientOptions::compress_threshold.
+  void GetWireStats(uint64_t* raw_bytes, uint64_t* wire_bytes,
+                    uint64_t* codec_micros) const;
+
  private:
   std::atomic<bool> connect_;
   std::shared_ptr<SaberClient> client_;
@@ -4,8 +4,11 @@
 
 #include "saber/client/saber_client.h"
 
+#include <algorithm>
 #include <utility>
+#include <vector>
 
+#include "saber/util/compression.h"
 #include "saber/util/logging.h"
 #include "saber/util/timeops.h"
 
@@ -32,16 +35,27 @@ void SaberClient::WeakCallback(std::weak_ptr<SaberClient> client_wp,
 
 SaberClient::SaberClient(voyager::EventLoop* loop, const ClientOptions& options)
     : kRoot(options.root),
+      kTraceSampleRate(options.trace_sample_rate),
+      kCoalesceWindow(options.notification_coalesce_window),
+      kMaxChunkSize(options.max_chunk_size),
+      kCompressThreshold(options.compress_threshold),
       has_started_(false),
       state_(SS_DISCONNECTED),
       can_send_(false),
       message_id_(0),
       session_id_(0),
       retry_time_(50),
+      compress_threshold_(0),
+      compress_max_size_(0),
+      raw_bytes_(0),
+      wire_bytes_(0),
+      codec_micros_(0),
       loop_(loop),
       server_manager_(options.server_manager),
       server_manager_impl_(nullptr),
-      watch_manager_(options.watcher) {
+      watch_manager_(options.watcher),
+      cache_(options.enable_read_cache ? new ReadCache() : nullptr),
+      random_(std::random_device{}()) {
   codec_.SetMessageCallback(std::bind(&SaberClient::OnMessage, this,
                                       std::placeholders::_1,
                                       std::placeholders::_2));
@@ -154,17 +168,35 @@ bool SaberClient::Exists(const ExistsRequest& request, Watcher* watcher,
   }
 
   std::string data;
-  request.SerializeToString(&data);
-  loop_->RunInLoop(
-      [this, path = request.path(), data = std::move(data), context, watcher, cb]() {
+  if (cache_ && !request.with_data()) {
+    // Arm the watch of the cache.
+    ExistsRequest cached(request);
+    cached.set_watch(true);
+    cached.SerializeToString(&data);
+  } else {
+    request.SerializeToString(&data);
+  }
+  loop_->RunInLoop([this, path = request.path(),
+                    with_data = request.with_data(), data = std::move(data),
+                    context, watcher, cb]() {
+    ExistsResponse response;
+    if (!with_data && UseCache() && cache_->Exists(path, &response)) {
+      if (watcher) {
+        watch_manager_.AddDataWatcher(
+            path, watcher,
+            response.code() == RC_OK ? response.stat().modified_id() : 0);
+      }
+      cb(path, context, response);
+      return;
+    }
     ++message_id_;
     auto message = std::make_unique<SaberMessage>();
     message->set_type(MT_EXISTS);
     message->set_data(std::move(data));
     message->set_id(message_id_);
 
-    exists_queue_.push_back(
-        std::make_unique<ExistsRequestT>(message_id_, path, watcher, context, cb));
+    exists_queue_.push_back(std::make_unique<ExistsRequestT>(
+        message_id_, path, watcher, context, cb, 0, with_data));
     TrySendInLoop(std::move(message));
   });
   return true;
@@ -177,18 +209,52 @@ bool SaberClient::GetData(const GetDataRequest& request, Watcher* watcher,
     return false;
   }
 
+  // A ranged read is neither served by nor put into the cache.
+  bool partial = request.offset() != 0 || request.max_size() != 0;
+  bool cached = cache_ && !request.with_data() && !partial;
+  bool chunked = kMaxChunkSize > 0 && !partial;
   std::string data;
-  request.SerializeToString(&data);
-  loop_->RunInLoop(
-      [this, path = request.path(), data = std::move(data), context, watcher, cb]() {
+  if (cached || chunked) {
+    GetDataRequest r(request);
+    if (cached) {
+      // Arm the watch of the cache.
+      r.set_watch(true);
+    }
+    if (chunked) {
+      r.set_max_size(kMaxChunkSize);
+    }
+    r.SerializeToString(&data);
+  } else {
+    request.SerializeToString(&data);
+  }
+  loop_->RunInLoop([this, path = request.path(),
+                    with_data = request.with_data(),
+                    known_modified_id = request.known_modified_id(), partial,
+                    chunked, data = std::move(data), context, watcher, cb]() {
+    GetDataResponse response;
+    if (!with_data && !partial && UseCache() &&
+        cache_->GetData(path, &response)) {
+      if (known_modified_id != 0 &&
+          known_modified_id == response.stat().modified_id()) {
+        response.set_code(RC_NOT_MODIFIED);
+        response.clear_data();
+      }
+      if (watcher) {
+        watch_manager_.AddDataWatcher(path, watcher,
+                                      response.stat().modified_id());
+      }
+      cb(path, context, response);
+      return;
+    }
     ++message_id_;
     auto message = std::make_unique<SaberMessage>();
     message->set_type(MT_GETDATA);
     message->set_data(std::move(data));
     message->set_id(message_id_);
 
-    get_data_queue_.push_back(
-        std::make_unique<GetDataRequestT>(message_id_, path, watcher, context, cb));
+    get_data_queue_.push_back(std::make_unique<GetDataRequestT>(
+        message_id_, path, watcher, context, cb, 0, with_data, partial));
+    get_data_queue_.back()->chunked = chunked;
     TrySendInLoop(std::move(message));
   });
   return true;
@@ -201,18 +267,60 @@ bool SaberClient::SetData(const SetDataRequest& request, void* context,
     return false;
   }
 
+  // The chunks but the last one are answered at once, and only the answer
+  // of the last one is passed to the callback.
+  std::vector<std::string> chunks;
+  if (kMaxChunkSize > 0 && request.data().size() > kMaxChunkSize) {
+    SetDataRequest chunk(request);
+    for (size_t i = 0; i < request.data().size(); i += kMaxChunkSize) {
+      chunk.set_data(request.data().substr(i, kMaxChunkSize));
+      chunk.set_more(i + kMaxChunkSize < request.data().size());
+      chunk.set_upload_offset(static_cast<uint32_t>(i));
+      chunks.push_back(chunk.SerializeAsString());
+    }
+  } else {
+    chunks.push_back(request.SerializeAsString());
+  }
+  loop_->RunInLoop([this, path = request.path(), chunks = std::move(chunks),
+                    context, cb]() mutable {
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      ++message_id_;
+      auto message = std::make_unique<SaberMessage>();
+      message->set_type(MT_SETDATA);
+      message->set_data(std::move(chunks[i]));
+      message->set_id(message_id_);
+
+      SetDataCallback done = cb;
+      if (i + 1 < chunks.size()) {
+        done = [](const std::string&, void*, const SetDataResponse&) {};
+      }
+      set_data_queue_.push_back(std::make_unique<SetDataRequestT>(
+          message_id_, path, nullptr, context, done));
+      TrySendInLoop(std::move(message));
+    }
+  });
+  return true;
+}
+
+bool SaberClient::Increment(const IncrementRequest& request, void* context,
+                            const IncrementCallback& cb) {
+  if (GetRoot(request.path()) != kRoot) {
+    LOG_ERROR("error request path %s", request.path().c_str());
+    return false;
+  }
+
   std::string data;
   request.SerializeToString(&data);
   loop_->RunInLoop(
       [this, path = request.path(), data = std::move(data), context, cb]() {
     ++message_id_;
     auto message = std::make_unique<SaberMessage>();
-    message->set_type(MT_SETDATA);
+    message->set_type(MT_INCREMENT);
     message->set_data(std::move(data));
     message->set_id(message_id_);
 
-    set_data_queue_.push_back(
-        std::make_unique<SetDataRequestT>(message_id_, path, nullptr, context, cb));
+    increment_queue_.push_back(std::make_unique<IncrementRequestT>(
+        message_id_, path, nullptr, context, cb));
     TrySendInLoop(std::move(message));
   });
   return true;
@@ -226,23 +334,235 @@ bool SaberClient::GetChildren(const GetChildrenRequest& request,
     return false;
   }
 
+  bool partial = request.with_nodes() || !request.start_after().empty() ||
+                 request.max_children() > 0 || !request.prefix().empty();
+  std::string data;
+  if (cache_ && !partial) {
+    // Arm the watch of the cache.
+    GetChildrenRequest cached(request);
+    cached.set_watch(true);
+    cached.SerializeToString(&data);
+  } else {
+    request.SerializeToString(&data);
+  }
+  loop_->RunInLoop([this, path = request.path(), partial,
+                    data = std::move(data), context, watcher, cb]() {
+    GetChildrenResponse response;
+    if (!partial && UseCache() && cache_->GetChildren(path, &response)) {
+      if (watcher) {
+        watch_manager_.AddChildWatcher(path, watcher,
+                                       response.stat().children_id());
+      }
+      cb(path, context, response);
+      return;
+    }
+    ++message_id_;
+    auto message = std::make_unique<SaberMessage>();
+    message->set_type(MT_GETCHILDREN);
+    message->set_data(std::move(data));
+    message->set_id(message_id_);
+
+    children_queue_.push_back(std::make_unique<GetChildrenRequestT>(
+        message_id_, path, watcher, context, cb, 0, false, partial));
+    TrySendInLoop(std::move(message));
+  });
+  return true;
+}
+
+bool SaberClient::GetSubtree(const GetSubtreeRequest& request, void* context,
+                             const GetSubtreeCallback& cb) {
+  if (GetRoot(request.path()) != kRoot) {
+    LOG_ERROR("error request path %s", request.path().c_str());
+    return false;
+  }
+
   std::string data;
   request.SerializeToString(&data);
   loop_->RunInLoop(
-      [this, path = request.path(), data = std::move(data), context, watcher, cb]() {
+      [this, path = request.path(), data = std::move(data), context, cb]() {
     ++message_id_;
     auto message = std::make_unique<SaberMessage>();
-    message->set_type(MT_GETCHILDREN);
+    message->set_type(MT_GETSUBTREE);
+    message->set_data(std::move(data));
+    message->set_id(message_id_);
+
+    subtree_queue_.push_back(std::make_unique<GetSubtreeRequestT>(
+        message_id_, path, nullptr, context, cb));
+    TrySendInLoop(std::move(message));
+  });
+  return true;
+}
+
+bool SaberClient::MultiGetData(const MultiGetDataRequest& request,
+                               Watcher* watcher, void* context,
+                               const MultiGetDataCallback& cb) {
+  for (const auto& r : request.requests()) {
+    if (GetRoot(r.path()) != kRoot) {
+      LOG_ERROR("error request path %s", r.path().c_str());
+      return false;
+    }
+  }
+
+  // The read cache is bypassed, the reads must come from one snapshot.
+  MultiGetDataCallback done = cb;
+  if (watcher) {
+    done = [this, request, watcher, cb](void* ctx,
+                                        const MultiGetDataResponse& response) {
+      int size = std::min(request.requests_size(), response.responses_size());
+      for (int i = 0; i < size; ++i) {
+        const GetDataRequest& r = request.requests(i);
+        const GetDataResponse& res = response.responses(i);
+        if (r.watch() &&
+            (res.code() == RC_OK || res.code() == RC_NOT_MODIFIED)) {
+          watch_manager_.AddDataWatcher(r.path(), watcher,
+                                        res.stat().modified_id(),
+                                        r.with_data());
+        }
+      }
+      cb(ctx, response);
+    };
+  }
+
+  std::string data;
+  request.SerializeToString(&data);
+  loop_->RunInLoop([this, data = std::move(data), context, done]() {
+    ++message_id_;
+    auto message = std::make_unique<SaberMessage>();
+    message->set_type(MT_MULTIGETDATA);
+    message->set_data(std::move(data));
+    message->set_id(message_id_);
+
+    multi_get_data_queue_.push_back(std::make_unique<MultiGetDataRequestT>(
+        message_id_, "", nullptr, context, done));
+    TrySendInLoop(std::move(message));
+  });
+  return true;
+}
+
+bool SaberClient::Multi(const MultiRequest& request, void* context,
+                        const MultiCallback& cb) {
+  std::vector<std::string> paths;
+  for (const auto& op : request.ops()) {
+    const std::string& path =
+        op.type() == MT_CREATE ? op.create().path()
+        : op.type() == MT_DELETE ? op.remove().path()
+        : op.type() == MT_SETDATA ? op.set_data().path()
+        : op.check().path();
+    if (GetRoot(path) != kRoot) {
+      LOG_ERROR("error request path %s", path.c_str());
+      return false;
+    }
+    if (op.type() != MT_CHECK) {
+      paths.push_back(path);
+    }
+  }
+
+  std::string data;
+  request.SerializeToString(&data);
+  loop_->RunInLoop([this, data = std::move(data), paths = std::move(paths),
+                    context, cb]() mutable {
+    ++message_id_;
+    auto message = std::make_unique<SaberMessage>();
+    message->set_type(MT_MULTI);
+    message->set_data(std::move(data));
+    message->set_id(message_id_);
+
+    auto multi =
+        std::make_unique<MultiRequestT>(message_id_, "", nullptr, context, cb);
+    multi->paths = std::move(paths);
+    multi_queue_.push_back(std::move(multi));
+    TrySendInLoop(std::move(message));
+  });
+  return true;
+}
+
+bool SaberClient::AddWatch(const AddWatchRequest& request, Watcher* watcher,
+                           void* context, const AddWatchCallback& cb) {
+  if (GetRoot(request.path()) != kRoot || !watcher) {
+    LOG_ERROR("error request path %s", request.path().c_str());
+    return false;
+  }
+
+  std::string data;
+  request.SerializeToString(&data);
+  loop_->RunInLoop([this, path = request.path(), mode = request.mode(),
+                    with_data = request.with_data(), data = std::move(data),
+                    context, watcher, cb]() {
+    ++message_id_;
+    auto message = std::make_unique<SaberMessage>();
+    message->set_type(MT_ADDWATCH);
+    message->set_data(std::move(data));
+    message->set_id(message_id_);
+
+    add_watch_queue_.push_back(std::make_unique<AddWatchRequestT>(
+        message_id_, path, watcher, context, cb, mode, with_data));
+    TrySendInLoop(std::move(message));
+  });
+  return true;
+}
+
+bool SaberClient::RemoveWatch(const RemoveWatchRequest& request,
+                              Watcher* watcher, void* context,
+                              const RemoveWatchCallback& cb) {
+  if (GetRoot(request.path()) != kRoot) {
+    LOG_ERROR("error request path %s", request.path().c_str());
+    return false;
+  }
+
+  std::string data;
+  request.SerializeToString(&data);
+  loop_->RunInLoop([this, path = request.path(), mode = request.mode(),
+                    data = std::move(data), context, watcher, cb]() {
+    // The server only knows the watch of the session, so it is removed
+    // there when no other watcher of the client uses it.
+    bool recursive = (mode == WM_PERSISTENT_RECURSIVE);
+    if (watch_manager_.RemovePersistentWatcher(path, watcher, recursive) > 0) {
+      RemoveWatchResponse response;
+      response.set_code(RC_OK);
+      cb(path, context, response);
+      return;
+    }
+    ++message_id_;
+    auto message = std::make_unique<SaberMessage>();
+    message->set_type(MT_REMOVEWATCH);
     message->set_data(std::move(data));
     message->set_id(message_id_);
 
-    children_queue_.push_back(
-        std::make_unique<GetChildrenRequestT>(message_id_, path, watcher, context, cb));
+    remove_watch_queue_.push_back(std::make_unique<RemoveWatchRequestT>(
+        message_id_, path, watcher, context, cb, mode));
     TrySendInLoop(std::move(message));
   });
   return true;
 }
 
+bool SaberClient::GetStats(const StatsRequest& request, void* context,
+                           const StatsCallback& cb) {
+  std::string data;
+  request.SerializeToString(&data);
+  loop_->RunInLoop([this, data = std::move(data), context, cb]() {
+    voyager::TcpConnectionPtr p;
+    if (client_) {
+      p = client_->GetTcpConnectionPtr();
+    }
+    if (!p) {
+      StatsResponse response;
+      response.set_code(RC_UNKNOWN);
+      cb(context, response);
+      return;
+    }
+    ++message_id_;
+    SaberMessage message;
+    message.set_type(MT_STATS);
+    message.set_data(std::move(data));
+    message.set_id(message_id_);
+
+    stats_queue_.push_back(
+        std::make_unique<StatsRequestT>(message_id_, "", nullptr, context, cb));
+    codec_.SendMessage(p, message);
+  });
+  return true;
+}
+
 void SaberClient::Connect(const voyager::SockAddr& addr) {
   if (!has_started_) {
     return;
@@ -261,22 +581,55 @@ void SaberClient::Connect(const voyager::SockAddr& addr) {
 }
 
 void SaberClient::TrySendInLoop(std::unique_ptr<SaberMessage> message) {
+  if (kTraceSampleRate > 0 &&
+      std::uniform_real_distribution<double>(0.0, 1.0)(random_) <
+          kTraceSampleRate) {
+    uint64_t trace_id = 0;
+    while (trace_id == 0) {
+      trace_id = random_();
+    }
+    message->set_trace_id(trace_id);
+    traces_[message->id()] = NowMicros();
+  }
   outgoing_queue_.push_back(std::move(message));
   if (can_send_) {
-    codec_.SendMessage(client_->GetTcpConnectionPtr(),
-                       *(outgoing_queue_.back()));
+    SendMessage(client_->GetTcpConnectionPtr(), *(outgoing_queue_.back()));
   }
 }
 
+void SaberClient::SendMessage(const voyager::TcpConnectionPtr& p,
+                              const SaberMessage& message) {
+  if (compress_threshold_ > 0 &&
+      message.data().size() >= compress_threshold_ &&
+      message.data().size() <= compress_max_size_) {
+    // The outgoing messages are kept uncompressed, since they may be sent
+    // again to a server which doesn't compress.
+    SaberMessage compressed(message);
+    uint64_t start = NowMicros();
+    bool b = CompressMessage(compress_threshold_, &compressed);
+    codec_micros_ += NowMicros() - start;
+    if (b) {
+      raw_bytes_ += message.data().size();
+      wire_bytes_ += compressed.data().size();
+      codec_.SendMessage(p, compressed);
+      return;
+    }
+  }
+  codec_.SendMessage(p, message);
+}
+
 void SaberClient::OnConnection(const voyager::TcpConnectionPtr& p) {
   LOG_DEBUG("SaberClient::OnConnection - connect successfully!");
   ConnectRequest request;
   request.set_session_id(session_id_);
+  request.set_coalesce_window(kCoalesceWindow);
+  request.set_compress_threshold(kCompressThreshold);
   SaberMessage message;
   message.set_id(message_id_++);
   message.set_type(MT_CONNECT);
   message.set_data(request.SerializeAsString());
   message.set_extra_data(kRoot);
+  compress_threshold_ = 0;
   codec_.SendMessage(p, message);
   server_manager_->OnConnection();
   if (state_ != SS_CONNECTING) {
@@ -304,6 +657,7 @@ void SaberClient::OnClose(const voyager::TcpConnectionPtr& p) {
   LOG_DEBUG("SaberClient::OnClose - connect close! master %s",
             master_.ShortDebugString().c_str());
   can_send_ = false;
+  FailStats();
   loop_->RemoveTimer(timer_);
   loop_->RemoveTimer(delay_);
   if (state_ != SS_DISCONNECTED) {
@@ -322,6 +676,21 @@ void SaberClient::OnClose(const voyager::TcpConnectionPtr& p) {
 
 bool SaberClient::OnMessage(const voyager::TcpConnectionPtr& p,
                             std::unique_ptr<SaberMessage> message) {
+  if (message->compressed()) {
+    size_t size = message->data().size();
+    uint64_t start = NowMicros();
+    // The replies come from the server, which is trusted, only the size
+    // header of the codec limits them.
+    if (!UncompressMessage(UINT32_MAX, message.get())) {
+      LOG_WARN("The compressed data of the message is corrupted.");
+      p->ForceClose();
+      return false;
+    }
+    codec_micros_ += NowMicros() - start;
+    raw_bytes_ += message->data().size();
+    wire_bytes_ += size;
+  }
+
   bool done = true;
   bool result = true;
   MessageType type = message->type();
@@ -330,6 +699,10 @@ bool SaberClient::OnMessage(const voyager::TcpConnectionPtr& p,
       done = false;
       OnNotification(message.get());
       break;
+    case MT_NOTIFICATION_BATCH:
+      done = false;
+      OnNotificationBatch(message.get());
+      break;
     case MT_CREATE:
       result = OnCreate(message.get());
       break;
@@ -348,6 +721,24 @@ bool SaberClient::OnMessage(const voyager::TcpConnectionPtr& p,
     case MT_GETCHILDREN:
       result = OnGetChildren(message.get());
       break;
+    case MT_ADDWATCH:
+      result = OnAddWatch(message.get());
+      break;
+    case MT_REMOVEWATCH:
+      result = OnRemoveWatch(message.get());
+      break;
+    case MT_MULTI:
+      result = OnMulti(message.get());
+      break;
+    case MT_INCREMENT:
+      result = OnIncrement(message.get());
+      break;
+    case MT_MULTIGETDATA:
+      result = OnMultiGetData(message.get());
+      break;
+    case MT_GETSUBTREE:
+      result = OnGetSubtree(message.get());
+      break;
     case MT_MASTER: {
       done = false;
       master_.Clear();
@@ -370,6 +761,13 @@ bool SaberClient::OnMessage(const voyager::TcpConnectionPtr& p,
       done = false;
       server_manager_->UpdateServers(message->data());
       break;
+    case MT_STATS:
+      done = false;
+      OnStats(message.get());
+      break;
+    case MT_SETWATCHES:
+      done = false;
+      break;
     default: {
       assert(false);
       done = false;
@@ -389,6 +787,15 @@ bool SaberClient::OnMessage(const voyager::TcpConnectionPtr& p,
           outgoing_queue_.front()->id());
     }
   }
+  if (done && message->trace_id() != 0) {
+    auto it = traces_.find(message->id());
+    if (it != traces_.end()) {
+      LOG_INFO("Trace %016llx: type:%d, id:%d, %llu us.",
+               (unsigned long long)message->trace_id(), type, message->id(),
+               (unsigned long long)(NowMicros() - it->second));
+      traces_.erase(it);
+    }
+  }
   if (done) {
     assert(!outgoing_queue_.empty());
     assert(outgoing_queue_.front()->id() == message->id());
@@ -419,6 +826,16 @@ void SaberClient::OnNotification(SaberMessage* message) {
   watch_manager_.TriggerWatcher(event);
 }
 
+void SaberClient::OnNotificationBatch(SaberMessage* message) {
+  NotificationBatch batch;
+  batch.ParseFromString(message->data());
+  for (int i = 0; i < batch.events_size(); ++i) {
+    WatchedEvent event;
+    event.ParseFromString(batch.events(i));
+    watch_manager_.TriggerWatcher(event);
+  }
+}
+
 void SaberClient::OnConnect(SaberMessage* message) {
   ConnectResponse response;
   response.ParseFromString(message->data());
@@ -431,9 +848,20 @@ void SaberClient::OnConnect(SaberMessage* message) {
     }
     state_ = SS_CONNECTED;
     TriggerState();
+    compress_threshold_ = response.compress_threshold();
+    compress_max_size_ = response.compress_max_size();
     auto p = client_->GetTcpConnectionPtr();
+    SetWatchesRequest request;
+    if (watch_manager_.GetWatches(&request)) {
+      // Before the outgoing messages, so that their watches are not fired
+      // again by the old ids.
+      SaberMessage set_watches;
+      set_watches.set_type(MT_SETWATCHES);
+      set_watches.set_data(request.SerializeAsString());
+      SendMessage(p, set_watches);
+    }
     for (auto& i : outgoing_queue_) {
-      codec_.SendMessage(p, *i);
+      SendMessage(p, *i);
     }
     can_send_ = true;
     uint64_t timeout = response.timeout();
@@ -471,6 +899,10 @@ bool SaberClient::OnCreate(SaberMessage* message) {
     return false;
   }
   response.ParseFromString(message->data());
+  if (cache_) {
+    // A sequential node is created with a suffix.
+    cache_->Drop(response.path().empty() ? request->path : response.path());
+  }
   request->callback(request->path, request->context, response);
   return true;
 }
@@ -496,6 +928,9 @@ bool SaberClient::OnDelete(SaberMessage* message) {
     return false;
   }
   response.ParseFromString(message->data());
+  if (cache_) {
+    cache_->Drop(request->path);
+  }
   request->callback(request->path, request->context, response);
   return true;
 }
@@ -522,9 +957,19 @@ bool SaberClient::OnExists(SaberMessage* message) {
   }
   response.ParseFromString(message->data());
   request->callback(request->path, request->context, response);
+  if (cache_ && !request->with_data &&
+      (response.code() == RC_OK || response.code() == RC_NO_NODE)) {
+    watch_manager_.AddDataWatcher(
+        request->path, cache_.get(),
+        response.code() == RC_OK ? response.stat().modified_id() : 0);
+    cache_->PutExists(request->path, response);
+  }
   if (request->watcher &&
       (response.code() == RC_OK || response.code() == RC_NO_NODE)) {
-    watch_manager_.AddDataWatcher(request->path, request->watcher);
+    watch_manager_.AddDataWatcher(
+        request->path, request->watcher,
+        response.code() == RC_OK ? response.stat().modified_id() : 0,
+        request->with_data);
   }
   return true;
 }
@@ -550,8 +995,48 @@ bool SaberClient::OnGetData(SaberMessage* message) {
     return false;
   }
   response.ParseFromString(message->data());
-  if (request->watcher && response.code() == RC_OK) {
-    watch_manager_.AddDataWatcher(request->path, request->watcher);
+  if (request->chunked && response.code() == RC_OK) {
+    // Read it again from the start if it has changed between the chunks.
+    bool changed = !request->chunks.empty() &&
+                   request->chunk_id != response.stat().modified_id();
+    if (changed) {
+      request->chunks.clear();
+    } else {
+      request->chunks.append(response.data());
+      request->chunk_id = response.stat().modified_id();
+    }
+    if (changed || request->chunks.size() <
+                       static_cast<size_t>(response.stat().data_len())) {
+      GetDataRequest next;
+      next.set_path(request->path);
+      next.set_offset(static_cast<uint32_t>(request->chunks.size()));
+      next.set_max_size(kMaxChunkSize);
+
+      ++message_id_;
+      auto next_message = std::make_unique<SaberMessage>();
+      next_message->set_type(MT_GETDATA);
+      next_message->set_data(next.SerializeAsString());
+      next_message->set_id(message_id_);
+
+      request->message_id = message_id_;
+      get_data_queue_.push_back(std::move(request));
+      TrySendInLoop(std::move(next_message));
+      return true;
+    }
+    response.set_data(std::move(request->chunks));
+  }
+  if (cache_ && !request->with_data && !request->partial &&
+      response.code() == RC_OK &&
+      response.data().size() == response.stat().data_len()) {
+    watch_manager_.AddDataWatcher(request->path, cache_.get(),
+                                  response.stat().modified_id());
+    cache_->PutData(request->path, response);
+  }
+  if (request->watcher &&
+      (response.code() == RC_OK || response.code() == RC_NOT_MODIFIED)) {
+    watch_manager_.AddDataWatcher(request->path, request->watcher,
+                                  response.stat().modified_id(),
+                                  request->with_data);
   }
   request->callback(request->path, request->context, response);
   return true;
@@ -578,6 +1063,9 @@ bool SaberClient::OnSetData(SaberMessage* message) {
     return false;
   }
   response.ParseFromString(message->data());
+  if (cache_) {
+    cache_->Drop(request->path);
+  }
   request->callback(request->path, request->context, response);
   return true;
 }
@@ -603,13 +1091,232 @@ bool SaberClient::OnGetChildren(SaberMessage* message) {
     return false;
   }
   response.ParseFromString(message->data());
+  // The server doesn't watch the children of the ephemeral nodes.
+  if (cache_ && !request->partial && response.code() == RC_OK &&
+      response.stat().ephemeral_id() == 0) {
+    watch_manager_.AddChildWatcher(request->path, cache_.get(),
+                                   response.stat().children_id());
+    cache_->PutChildren(request->path, response);
+  }
   if (request->watcher && response.code() == RC_OK) {
-    watch_manager_.AddChildWatcher(request->path, request->watcher);
+    watch_manager_.AddChildWatcher(request->path, request->watcher,
+                                   response.stat().children_id());
+  }
+  request->callback(request->path, request->context, response);
+  return true;
+}
+
+bool SaberClient::OnAddWatch(SaberMessage* message) {
+  if (add_watch_queue_.empty()) {
+    return false;
+  }
+  AddWatchResponse response;
+  response.set_code(RC_UNKNOWN);
+  auto request = std::move(add_watch_queue_.front());
+  add_watch_queue_.pop_front();
+  assert(message->id() == request->message_id);
+  while (message->id() > request->message_id) {
+    request->callback(request->path, request->context, response);
+    if (add_watch_queue_.empty()) {
+      return false;
+    }
+    request = std::move(add_watch_queue_.front());
+    add_watch_queue_.pop_front();
+  }
+  if (message->id() != request->message_id) {
+    return false;
+  }
+  response.ParseFromString(message->data());
+  if (response.code() == RC_OK) {
+    watch_manager_.AddPersistentWatcher(
+        request->path, request->watcher,
+        request->mode == WM_PERSISTENT_RECURSIVE, request->with_data);
+  }
+  request->callback(request->path, request->context, response);
+  return true;
+}
+
+bool SaberClient::OnRemoveWatch(SaberMessage* message) {
+  if (remove_watch_queue_.empty()) {
+    return false;
+  }
+  RemoveWatchResponse response;
+  response.set_code(RC_UNKNOWN);
+  auto request = std::move(remove_watch_queue_.front());
+  remove_watch_queue_.pop_front();
+  assert(message->id() == request->message_id);
+  while (message->id() > request->message_id) {
+    request->callback(request->path, request->context, response);
+    if (remove_watch_queue_.empty()) {
+      return false;
+    }
+    request = std::move(remove_watch_queue_.front());
+    remove_watch_queue_.pop_front();
+  }
+  if (message->id() != request->message_id) {
+    return false;
+  }
+  response.ParseFromString(message->data());
+  request->callback(request->path, request->context, response);
+  return true;
+}
+
+bool SaberClient::OnIncrement(SaberMessage* message) {
+  if (increment_queue_.empty()) {
+    return false;
+  }
+  IncrementResponse response;
+  response.set_code(RC_UNKNOWN);
+  auto request = std::move(increment_queue_.front());
+  increment_queue_.pop_front();
+  assert(message->id() == request->message_id);
+  while (message->id() > request->message_id) {
+    request->callback(request->path, request->context, response);
+    if (increment_queue_.empty()) {
+      return false;
+    }
+    request = std::move(increment_queue_.front());
+    increment_queue_.pop_front();
   }
+  if (message->id() != request->message_id) {
+    return false;
+  }
+  response.ParseFromString(message->data());
+  if (cache_) {
+    cache_->Drop(request->path);
+  }
+  request->callback(request->path, request->context, response);
+  return true;
+}
+
+bool SaberClient::OnMulti(SaberMessage* message) {
+  if (multi_queue_.empty()) {
+    return false;
+  }
+  MultiResponse response;
+  response.set_code(RC_UNKNOWN);
+  auto request = std::move(multi_queue_.front());
+  multi_queue_.pop_front();
+  assert(message->id() == request->message_id);
+  while (message->id() > request->message_id) {
+    request->callback(request->context, response);
+    if (multi_queue_.empty()) {
+      return false;
+    }
+    request = std::move(multi_queue_.front());
+    multi_queue_.pop_front();
+  }
+  if (message->id() != request->message_id) {
+    return false;
+  }
+  response.ParseFromString(message->data());
+  if (cache_) {
+    for (auto& path : request->paths) {
+      cache_->Drop(path);
+    }
+    for (auto& result : response.results()) {
+      if (!result.path().empty()) {
+        cache_->Drop(result.path());
+      }
+    }
+  }
+  request->callback(request->context, response);
+  return true;
+}
+
+bool SaberClient::OnMultiGetData(SaberMessage* message) {
+  if (multi_get_data_queue_.empty()) {
+    return false;
+  }
+  MultiGetDataResponse response;
+  response.set_code(RC_UNKNOWN);
+  auto request = std::move(multi_get_data_queue_.front());
+  multi_get_data_queue_.pop_front();
+  assert(message->id() == request->message_id);
+  while (message->id() > request->message_id) {
+    request->callback(request->context, response);
+    if (multi_get_data_queue_.empty()) {
+      return false;
+    }
+    request = std::move(multi_get_data_queue_.front());
+    multi_get_data_queue_.pop_front();
+  }
+  if (message->id() != request->message_id) {
+    return false;
+  }
+  response.ParseFromString(message->data());
+  request->callback(request->context, response);
+  return true;
+}
+
+bool SaberClient::OnGetSubtree(SaberMessage* message) {
+  if (subtree_queue_.empty()) {
+    return false;
+  }
+  GetSubtreeResponse response;
+  response.set_code(RC_UNKNOWN);
+  auto request = std::move(subtree_queue_.front());
+  subtree_queue_.pop_front();
+  assert(message->id() == request->message_id);
+  while (message->id() > request->message_id) {
+    request->callback(request->path, request->context, response);
+    if (subtree_queue_.empty()) {
+      return false;
+    }
+    request = std::move(subtree_queue_.front());
+    subtree_queue_.pop_front();
+  }
+  if (message->id() != request->message_id) {
+    return false;
+  }
+  response.ParseFromString(message->data());
   request->callback(request->path, request->context, response);
+  if (response.code() == RC_OK && !response.done()) {
+    // Only one chunk of a stream is in flight.
+    GetSubtreeRequest next;
+    next.set_path(request->path);
+    next.set_stream_id(response.stream_id());
+
+    ++message_id_;
+    auto next_message = std::make_unique<SaberMessage>();
+    next_message->set_type(MT_GETSUBTREE);
+    next_message->set_data(next.SerializeAsString());
+    next_message->set_id(message_id_);
+
+    request->message_id = message_id_;
+    subtree_queue_.push_back(std::move(request));
+    TrySendInLoop(std::move(next_message));
+  }
   return true;
 }
 
+void SaberClient::OnStats(SaberMessage* message) {
+  StatsResponse response;
+  response.set_code(RC_UNKNOWN);
+  while (!stats_queue_.empty() &&
+         message->id() >= stats_queue_.front()->message_id) {
+    auto request = std::move(stats_queue_.front());
+    stats_queue_.pop_front();
+    if (message->id() == request->message_id) {
+      response.ParseFromString(message->data());
+      request->callback(request->context, response);
+      return;
+    }
+    request->callback(request->context, response);
+  }
+  LOG_WARN("Invalid stats message, id:%d.", message->id());
+}
+
+void SaberClient::FailStats() {
+  StatsResponse response;
+  response.set_code(RC_UNKNOWN);
+  while (!stats_queue_.empty()) {
+    auto request = std::move(stats_queue_.front());
+    stats_queue_.pop_front();
+    request->callback(request->context, response);
+  }
+}
+
 void SaberClient::TriggerState() {
   WatchedEvent event;
   event.set_type(ET_NONE);
@@ -617,14 +1324,41 @@ void SaberClient::TriggerState() {
   watch_manager_.TriggerWatcher(event);
 }
 
+bool SaberClient::UseCache() const {
+  // Read its own writes.
+  return cache_ && create_queue_.empty() && delete_queue_.empty() &&
+         set_data_queue_.empty() && increment_queue_.empty() &&
+         multi_queue_.empty();
+}
+
+void SaberClient::GetCacheStats(uint64_t* hits, uint64_t* misses) const {
+  *hits = cache_ ? cache_->hits() : 0;
+  *misses = cache_ ? cache_->misses() : 0;
+}
+
+void SaberClient::GetWireStats(uint64_t* raw_bytes, uint64_t* wire_bytes,
+                               uint64_t* codec_micros) const {
+  *raw_bytes = raw_bytes_;
+  *wire_bytes = wire_bytes_;
+  *codec_micros = codec_micros_;
+}
+
 void SaberClient::ClearMessage() {
   create_queue_.clear();
   delete_queue_.clear();
   exists_queue_.clear();
   get_data_queue_.clear();
   set_data_queue_.clear();
+  increment_queue_.clear();
   children_queue_.clear();
+  add_watch_queue_.clear();
+  remove_watch_queue_.clear();
+  stats_queue_.clear();
+  multi_queue_.clear();
+  multi_get_data_queue_.clear();
+  subtree_queue_.clear();
   outgoing_queue_.clear();
+  traces_.clear();
 }
 
 }  // namespace saber
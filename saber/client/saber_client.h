@@ -8,7 +8,9 @@
 #include <atomic>
 #include <deque>
 #include <memory>
+#include <random>
 #include <string>
+#include <unordered_map>
 
 #include <voyager/core/eventloop.h>
 #include <voyager/core/tcp_client.h>
@@ -17,6 +19,7 @@
 #include "saber/client/callbacks.h"
 #include "saber/client/client_options.h"
 #include "saber/client/client_watch_manager.h"
+#include "saber/client/read_cache.h"
 #include "saber/client/saber_request.h"
 #include "saber/client/server_manager.h"
 #include "saber/client/server_manager_impl.h"
@@ -47,15 +50,58 @@ class SaberClient : public std::enable_shared_from_this<SaberClient> {
   bool SetData(const SetDataRequest& request, void* context,
                const SetDataCallback& cb);
 
+  bool Increment(const IncrementRequest& request, void* context,
+                 const IncrementCallback& cb);
+
   bool GetChildren(const GetChildrenRequest& request, Watcher* watcher,
                    void* context, const GetChildrenCallback& cb);
 
+  // Add a persistent or recursive watch, it stays registered until it is
+  // removed by RemoveWatch.
+  bool AddWatch(const AddWatchRequest& request, Watcher* watcher,
+                void* context, const AddWatchCallback& cb);
+
+  bool RemoveWatch(const RemoveWatchRequest& request, Watcher* watcher,
+                   void* context, const RemoveWatchCallback& cb);
+
+  // Get the live state of the connected server, it doesn't need the session,
+  // and isn't resent on reconnect, it fails with RC_UNKNOWN when the
+  // connection is closed, and with RC_FAILED unless the server enables it
+  // (ServerOptions::enable_stats).
+  bool GetStats(const StatsRequest& request, void* context,
+                const StatsCallback& cb);
+
+  // Read a whole subtree in chunks, the next chunk is requested after the
+  // callback of the last one returns.
+  bool GetSubtree(const GetSubtreeRequest& request, void* context,
+                  const GetSubtreeCallback& cb);
+
+  // Read many nodes in one round trip, the watcher is set for the requests
+  // with watch.
+  bool MultiGetData(const MultiGetDataRequest& request, Watcher* watcher,
+                    void* context, const MultiGetDataCallback& cb);
+
+  // All or nothing, see MultiRequest.
+  bool Multi(const MultiRequest& request, void* context,
+             const MultiCallback& cb);
+
+  // The counters of the read cache, zero if it isn't enabled.
+  void GetCacheStats(uint64_t* hits, uint64_t* misses) const;
+
+  // The data size of the messages compressed or uncompressed on the wire
+  // before and after the compression, and the time (in microseconds) spent.
+  void GetWireStats(uint64_t* raw_bytes, uint64_t* wire_bytes,
+                    uint64_t* codec_micros) const;
+
  private:
   static void WeakCallback(std::weak_ptr<SaberClient> client_wp,
                            const voyager::TcpConnectionPtr& p);
   void CloseInLoop();
   void Connect(const voyager::SockAddr& addr);
   void TrySendInLoop(std::unique_ptr<SaberMessage> message);
+  // Send the message, whose data is compressed if it is worth it.
+  void SendMessage(const voyager::TcpConnectionPtr& p,
+                   const SaberMessage& message);
   void OnConnection(const voyager::TcpConnectionPtr& p);
   void OnFailue();
   void OnClose(const voyager::TcpConnectionPtr& p);
@@ -65,31 +111,54 @@ class SaberClient : public std::enable_shared_from_this<SaberClient> {
                voyager::ProtoCodecError code);
   void OnTimer();
   void OnNotification(SaberMessage* message);
+  void OnNotificationBatch(SaberMessage* message);
   void OnConnect(SaberMessage* message);
   bool OnCreate(SaberMessage* message);
   bool OnDelete(SaberMessage* message);
   bool OnExists(SaberMessage* message);
   bool OnGetData(SaberMessage* message);
   bool OnSetData(SaberMessage* message);
+  bool OnIncrement(SaberMessage* message);
   bool OnGetChildren(SaberMessage* message);
+  bool OnAddWatch(SaberMessage* message);
+  bool OnRemoveWatch(SaberMessage* message);
+  bool OnMulti(SaberMessage* message);
+  bool OnMultiGetData(SaberMessage* message);
+  bool OnGetSubtree(SaberMessage* message);
+  void OnStats(SaberMessage* message);
+  void FailStats();
   void TriggerState();
   void ClearMessage();
+  bool UseCache() const;
 
   const std::string kRoot;
   static const uint64_t kMaxRetryTime = 1000;
 
+  const double kTraceSampleRate;
+  const uint32_t kCoalesceWindow;
+  const uint32_t kMaxChunkSize;
+  const uint32_t kCompressThreshold;
+
   std::atomic<bool> has_started_;
   SessionState state_;
   bool can_send_;
   uint32_t message_id_;
   uint64_t session_id_;
   uint64_t retry_time_;
+  // The threshold agreed by the server of the current connection, and the
+  // max size of the messages it accepts compressed.
+  uint32_t compress_threshold_;
+  uint32_t compress_max_size_;
+  std::atomic<uint64_t> raw_bytes_;
+  std::atomic<uint64_t> wire_bytes_;
+  std::atomic<uint64_t> codec_micros_;
 
   voyager::EventLoop* loop_;
   ServerManager* server_manager_;
   ServerManagerImpl* server_manager_impl_;
 
   ClientWatchManager watch_manager_;
+  std::unique_ptr<ReadCache> cache_;
   voyager::ProtobufCodec<SaberMessage> codec_;
   std::unique_ptr<voyager::TcpClient> client_;
 
@@ -98,10 +167,21 @@ class SaberClient : public std::enable_shared_from_this<SaberClient> {
   std::deque<std::unique_ptr<ExistsRequestT> > exists_queue_;
   std::deque<std::unique_ptr<GetDataRequestT> > get_data_queue_;
   std::deque<std::unique_ptr<SetDataRequestT> > set_data_queue_;
+  std::deque<std::unique_ptr<IncrementRequestT> > increment_queue_;
   std::deque<std::unique_ptr<GetChildrenRequestT> > children_queue_;
+  std::deque<std::unique_ptr<AddWatchRequestT> > add_watch_queue_;
+  std::deque<std::unique_ptr<RemoveWatchRequestT> > remove_watch_queue_;
+  std::deque<std::unique_ptr<StatsRequestT> > stats_queue_;
+  std::deque<std::unique_ptr<MultiRequestT> > multi_queue_;
+  std::deque<std::unique_ptr<MultiGetDataRequestT> > multi_get_data_queue_;
+  std::deque<std::unique_ptr<GetSubtreeRequestT> > subtree_queue_;
 
   std::deque<std::unique_ptr<SaberMessage> > outgoing_queue_;
 
+  // The send time of the traced messages by message id.
+  std::unordered_map<uint32_t, uint64_t> traces_;
+  std::mt19937_64 random_;
+
   voyager::TimerId timer_;
   voyager::TimerId delay_;
   Master master_;
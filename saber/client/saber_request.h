@@ -6,6 +6,7 @@
 #define SABER_CLIENT_SABER_REQUEST_H_
 
 #include <string>
+#include <vector>
 
 #include "saber/service/watcher.h"
 
@@ -19,10 +20,33 @@ class SaberRequest {
   Watcher* watcher;
   void* context;
   Callback callback;
+  // The WatchMode of AddWatch and RemoveWatch.
+  int mode;
+  // The with_data of Exists, GetData and AddWatch, kept by the watch.
+  bool with_data;
+  // A page, prefix or with_nodes of GetChildren, or a ranged GetData,
+  // which isn't cached.
+  bool partial;
+  // A GetData read in chunks, the data read so far and its modified_id.
+  bool chunked;
+  std::string chunks;
+  uint64_t chunk_id;
+  // The paths of the writes of Multi, dropped from the read cache when done.
+  std::vector<std::string> paths;
 
   SaberRequest(uint32_t id, const std::string& p, Watcher* w, void* ctx,
-               const Callback& cb)
-      : message_id(id), path(p), watcher(w), context(ctx), callback(cb) {}
+               const Callback& cb, int m = 0, bool wd = false,
+               bool pt = false)
+      : message_id(id),
+        path(p),
+        watcher(w),
+        context(ctx),
+        callback(cb),
+        mode(m),
+        with_data(wd),
+        partial(pt),
+        chunked(false),
+        chunk_id(0) {}
 };
 
 typedef SaberRequest<CreateCallback> CreateRequestT;
@@ -30,7 +54,14 @@ typedef SaberRequest<DeleteCallback> DeleteRequestT;
 typedef SaberRequest<ExistsCallback> ExistsRequestT;
 typedef SaberRequest<GetDataCallback> GetDataRequestT;
 typedef SaberRequest<SetDataCallback> SetDataRequestT;
+typedef SaberRequest<IncrementCallback> IncrementRequestT;
 typedef SaberRequest<GetChildrenCallback> GetChildrenRequestT;
+typedef SaberRequest<GetSubtreeCallback> GetSubtreeRequestT;
+typedef SaberRequest<AddWatchCallback> AddWatchRequestT;
+typedef SaberRequest<RemoveWatchCallback> RemoveWatchRequestT;
+typedef SaberRequest<StatsCallback> StatsRequestT;
+typedef SaberRequest<MultiCallback> MultiRequestT;
+typedef SaberRequest<MultiGetDataCallback> MultiGetDataRequestT;
 
 }  // namespace saber
 
@@ -24,6 +24,7 @@ void MySaber::GetLine() {
   printf("3. GetData\n");
   printf("4. SetData\n");
   printf("5. GetChildren\n");
+  printf("6. Stats\n");
   printf("> ");
   std::string s;
   std::getline(std::cin, s);
@@ -66,6 +67,10 @@ bool MySaber::NewRequest(const std::string& s) {
       GetChildren();
       break;
     }
+    case kStats: {
+      Stats();
+      break;
+    }
     default: {
       printf("Invalid request type.\n");
       res = false;
@@ -291,4 +296,21 @@ void MySaber::OnGetChildrenReply(const std::string& path, void* context,
   loop_->RunInLoop([this]() { GetLine(); });
 }
 
+void MySaber::Stats() {
+  StatsRequest request;
+  saber_.GetStats(request, nullptr,
+                  [this](void* context, const StatsResponse& response) {
+                    OnStatsReply(context, response);
+                  });
+}
+
+void MySaber::OnStatsReply(void* context, const StatsResponse& response) {
+  if (response.code() == RC_OK) {
+    printf("%s\n", response.stats().c_str());
+  } else {
+    printf("%s\n", response.ShortDebugString().c_str());
+  }
+  loop_->RunInLoop([this]() { GetLine(); });
+}
+
 }  // namespace saber
@@ -36,6 +36,7 @@ class MySaber {
     kGetData = 3,
     kSetData = 4,
     kGetChildren = 5,
+    kStats = 6,
   };
 
   void GetLine();
@@ -58,6 +59,8 @@ class MySaber {
   void GetChildren();
   void OnGetChildrenReply(const std::string& path, void* context,
                           const GetChildrenResponse& response);
+  void Stats();
+  void OnStatsReply(void* context, const StatsResponse& response);
 
   RunLoop* loop_;
   DefaultWatcher watcher_;
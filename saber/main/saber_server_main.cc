@@ -6,6 +6,7 @@
 #include <unistd.h>
 
 #include <saber/server/saber_server.h>
+#include <saber/util/async_logging.h>
 #include <saber/util/logging.h>
 #include <skywalker/logging.h>
 #include <voyager/core/eventloop.h>
@@ -66,6 +67,8 @@ int main(int argc, char** argv) {
   voyager::SetLogLevel(voyager::LOGLEVEL_ERROR);
   skywalker::SetLogLevel(skywalker::LOGLEVEL_WARN);
   saber::SetLogLevel(saber::LOGLEVEL_INFO);
+  saber::AsyncLoggingOptions logging_options;
+  saber::StartAsyncLogging(logging_options);
 
   bool res = saber_server.Start();
   if (res) {
@@ -78,5 +81,6 @@ int main(int argc, char** argv) {
     printf("SaberServer start failed!\n");
     printf("--------------------------------------------------------------\n");
   }
+  saber::StopAsyncLogging();
   return 0;
 }
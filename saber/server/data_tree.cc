@@ -3,11 +3,51 @@
 // found in the LICENSE file.
 
 #include "saber/server/data_tree.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <iterator>
+
+#include "saber/util/compression.h"
 #include "saber/util/logging.h"
 
 namespace saber {
 
-DataTree::DataTree() { nodes_.insert(std::make_pair("", DataNode())); }
+uint32_t DataTree::kCompressThreshold = 0;
+
+const std::string& DataTree::GetNodeData(const DataNode& node,
+                                         std::string* buffer) {
+  if (!node.compressed()) {
+    return node.data();
+  }
+  // The data was compressed by the tree itself, and is never bigger than
+  // what the varint32 size header can hold.
+  if (!Uncompress(node.data().data(), node.data().size(), UINT32_MAX,
+                  buffer)) {
+    LOG_FATAL("The compressed data of a node is corrupted.");
+  }
+  return *buffer;
+}
+
+void DataTree::SetNodeData(const std::string& data, DataNode* node) {
+  std::string compressed;
+  if (kCompressThreshold > 0 && data.size() >= kCompressThreshold &&
+      Compress(data.data(), data.size(), &compressed)) {
+    node->set_data(std::move(compressed));
+    node->set_compressed(true);
+  } else {
+    node->set_data(data);
+    node->set_compressed(false);
+  }
+}
+
+DataTree::DataTree(uint32_t max_data_size) : kMaxDataSize(max_data_size) {
+  nodes_.insert(std::make_pair("", DataNode()));
+}
 
 DataTree::~DataTree() {}
 
@@ -17,6 +57,7 @@ void DataTree::Recover(const DataNodeList& node_list) {
     new_node.set_type(node.type());
     new_node.mutable_stat()->CopyFrom(node.stat());
     new_node.set_data(node.data());
+    new_node.set_compressed(node.compressed());
 
     for (const auto& child : node.children()) {
       childrens_[node.path()].insert(child);
@@ -25,6 +66,10 @@ void DataTree::Recover(const DataNodeList& node_list) {
     if (node.stat().ephemeral_id() > 0) {
       ephemerals_[node.stat().ephemeral_id()].insert(node.path());
     }
+
+    if (!node.path().empty()) {
+      UpdateStats(node.path(), 1, static_cast<int64_t>(node.data().size()));
+    }
   }
 }
 
@@ -58,8 +103,32 @@ ResponseCode DataTree::ParsePath(const std::string& path,
   return RC_OK;
 }
 
+void DataTree::UpdateStats(const std::string& path, int64_t node_count,
+                           int64_t data_size) {
+  size_t i = path.find('/', 1);
+  NodeStats& root = root_stats_[path.substr(0, i)];
+  root.node_count += node_count;
+  root.data_size += data_size;
+  total_stats_.node_count += node_count;
+  total_stats_.data_size += data_size;
+  if (root.node_count == 0) {
+    root_stats_.erase(path.substr(0, i));
+  }
+}
+
 void DataTree::Create(const CreateRequest& request, const Transaction* txn,
                       CreateResponse* response, bool only_check) {
+  std::vector<Trigger> triggers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CreateLocked(request, txn, response, only_check, &triggers);
+  }
+  Fire(triggers);
+}
+
+void DataTree::CreateLocked(const CreateRequest& request,
+                            const Transaction* txn, CreateResponse* response,
+                            bool only_check, std::vector<Trigger>* triggers) {
   std::string path = request.path();
   std::string parent;
   std::string child;
@@ -69,73 +138,86 @@ void DataTree::Create(const CreateRequest& request, const Transaction* txn,
     return;
   }
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = nodes_.find(parent);
-    if (it == nodes_.end()) {
-      response->set_code(RC_NO_PARENT);
-      return;
-    }
-    if (it->second.type() == NT_EPHEMERAL ||
-        it->second.type() == NT_EPHEMERAL_SEQUENTIAL) {
-      response->set_code(RC_PARENT_EPHEMERAL);
-      return;
-    }
+  auto it = nodes_.find(parent);
+  if (it == nodes_.end()) {
+    response->set_code(RC_NO_PARENT);
+    return;
+  }
+  if (it->second.type() == NT_EPHEMERAL ||
+      it->second.type() == NT_EPHEMERAL_SEQUENTIAL) {
+    response->set_code(RC_PARENT_EPHEMERAL);
+    return;
+  }
 
-    if (it->second.type() == NT_PERSISTENT_SEQUENTIAL ||
-        it->second.type() == NT_EPHEMERAL_SEQUENTIAL) {
-      if (!only_check) {
-        char seq[16];
-        snprintf(seq, sizeof(seq), "_%010d",
-                 it->second.stat().children_version() + 1);
-        child.append(seq);
-        path.append(seq);
-      }
+  if (it->second.type() == NT_PERSISTENT_SEQUENTIAL ||
+      it->second.type() == NT_EPHEMERAL_SEQUENTIAL) {
+    if (!only_check) {
+      char seq[16];
+      snprintf(seq, sizeof(seq), "_%010d",
+               it->second.stat().children_version() + 1);
+      child.append(seq);
+      path.append(seq);
     }
-    std::unordered_set<std::string>& children = childrens_[parent];
-    if (children.find(child) != children.end()) {
-      response->set_code(RC_NODE_EXISTS);
-    } else if (only_check) {
-      response->set_code(RC_OK);
-    } else {
-      children.insert(child);
-      Stat* tmp = it->second.mutable_stat();
-      tmp->set_children_version(tmp->children_version() + 1);
-      tmp->set_children_num(static_cast<uint32_t>(children.size()));
-      tmp->set_children_id(txn->instance_id());
-      DataNode& node = nodes_[path];
-      Stat* stat = node.mutable_stat();
-      stat->set_group_id(txn->group_id());
-      stat->set_created_id(txn->instance_id());
-      stat->set_modified_id(txn->instance_id());
-      stat->set_created_time(txn->time());
-      stat->set_modified_time(txn->time());
-      stat->set_version(0);
-      stat->set_children_version(0);
-      stat->set_data_len(static_cast<uint32_t>(request.data().size()));
-      stat->set_children_num(0);
-      stat->set_children_id(txn->instance_id());
-      node.set_data(request.data());
-      node.set_type(request.node_type());
-      if (request.node_type() == NT_EPHEMERAL ||
-          request.node_type() == NT_EPHEMERAL_SEQUENTIAL) {
-        stat->set_ephemeral_id(txn->session_id());
+  }
+  std::set<std::string>& children = childrens_[parent];
+  if (children.find(child) != children.end()) {
+    response->set_code(RC_NODE_EXISTS);
+  } else if (only_check) {
+    response->set_code(RC_OK);
+  } else {
+    children.insert(child);
+    Stat* tmp = it->second.mutable_stat();
+    tmp->set_children_version(tmp->children_version() + 1);
+    tmp->set_children_num(static_cast<uint32_t>(children.size()));
+    tmp->set_children_id(txn->instance_id());
+    DataNode& node = nodes_[path];
+    Stat* stat = node.mutable_stat();
+    stat->set_group_id(txn->group_id());
+    stat->set_created_id(txn->instance_id());
+    stat->set_modified_id(txn->instance_id());
+    stat->set_created_time(txn->time());
+    stat->set_modified_time(txn->time());
+    stat->set_version(0);
+    stat->set_children_version(0);
+    stat->set_data_len(static_cast<uint32_t>(request.data().size()));
+    stat->set_children_num(0);
+    stat->set_children_id(txn->instance_id());
+    SetNodeData(request.data(), &node);
+    node.set_type(request.node_type());
+    if (request.node_type() == NT_EPHEMERAL ||
+        request.node_type() == NT_EPHEMERAL_SEQUENTIAL) {
+      stat->set_ephemeral_id(txn->session_id());
+      // The check of Multi runs with no session, and it is rolled back.
+      if (stat->ephemeral_id() != 0) {
         ephemerals_[stat->ephemeral_id()].insert(path);
       }
-      response->set_code(RC_OK);
-      response->set_path(path);
     }
-  }
-  if (!only_check && response->code() == RC_OK) {
-    data_watches_.TriggerWatcher(path, ET_NODE_CREATED);
+    UpdateStats(path, 1, static_cast<int64_t>(node.data().size()));
+    response->set_code(RC_OK);
+    response->set_path(path);
+    triggers->push_back(Trigger(path, ET_NODE_CREATED, stat, &request.data()));
     if (!parent.empty()) {
-      child_watches_.TriggerWatcher(parent, ET_NODE_CHILDREN_CHANGED);
+      triggers->push_back(Trigger(parent, ET_NODE_CHILDREN_CHANGED));
     }
   }
+  if (children.empty()) {
+    childrens_.erase(parent);
+  }
 }
 
 void DataTree::Delete(const DeleteRequest& request, const Transaction* txn,
                       DeleteResponse* response, bool only_check) {
+  std::vector<Trigger> triggers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeleteLocked(request, txn, response, only_check, &triggers);
+  }
+  Fire(triggers);
+}
+
+void DataTree::DeleteLocked(const DeleteRequest& request,
+                            const Transaction* txn, DeleteResponse* response,
+                            bool only_check, std::vector<Trigger>* triggers) {
   const std::string& path = request.path();
   std::string parent;
   std::string child;
@@ -145,65 +227,108 @@ void DataTree::Delete(const DeleteRequest& request, const Transaction* txn,
     return;
   }
 
-  {
-    std::lock_guard<std::mutex> lock(mutex_);
-    auto it = nodes_.find(path);
-    if (it == nodes_.end()) {
-      response->set_code(RC_NO_NODE);
-      return;
-    }
-    if (request.version() != -1 &&
-        request.version() != it->second.stat().version()) {
-      response->set_code(RC_BAD_VERSION);
-      return;
-    }
-    if (childrens_.find(path) != childrens_.end()) {
-      response->set_code(RC_CHILDREN_EXISTS);
-      return;
-    }
+  auto it = nodes_.find(path);
+  if (it == nodes_.end()) {
+    response->set_code(RC_NO_NODE);
+    return;
+  }
+  if (request.version() != -1 &&
+      request.version() != it->second.stat().version()) {
+    response->set_code(RC_BAD_VERSION);
+    return;
+  }
+  if (!request.recursive() && childrens_.find(path) != childrens_.end()) {
+    response->set_code(RC_CHILDREN_EXISTS);
+    return;
+  }
 
-    if (only_check) {
-      response->set_code(RC_OK);
-      return;
-    }
+  if (only_check) {
+    response->set_code(RC_OK);
+    return;
+  }
 
-    if (it->second.stat().ephemeral_id() != 0) {
-      auto e = ephemerals_.find(it->second.stat().ephemeral_id());
-      if (e != ephemerals_.end()) {
-        e->second.erase(path);
-        if (e->second.empty()) {
-          ephemerals_.erase(e);
-        }
+  if (request.recursive()) {
+    // Leaf first, so every parent inside the subtree gets one children
+    // changed event after the deleted events of all its children, and
+    // then its own deleted event.
+    std::vector<std::string> descendants;
+    GetDescendantsLocked(path, &descendants);
+    for (auto& d : descendants) {
+      EraseNodeLocked(d);
+      if (childrens_.erase(d) > 0) {
+        triggers->push_back(Trigger(d, ET_NODE_CHILDREN_CHANGED));
       }
+      triggers->push_back(Trigger(d, ET_NODE_DELETED));
     }
-    nodes_.erase(it);
-    auto p_it = nodes_.find(parent);
-    if (p_it != nodes_.end()) {
-      if (childrens_.find(parent) != childrens_.end()) {
-        std::unordered_set<std::string>& children = childrens_[parent];
-        if (children.erase(child)) {
-          Stat* tmp = p_it->second.mutable_stat();
-          tmp->set_children_version(tmp->children_version() + 1);
-          tmp->set_children_num(static_cast<uint32_t>(children.size()));
-          tmp->set_children_id(txn->instance_id());
-        }
-        if (children.empty()) {
-          childrens_.erase(parent);
-        }
+    if (childrens_.erase(path) > 0) {
+      triggers->push_back(Trigger(path, ET_NODE_CHILDREN_CHANGED));
+    }
+  }
+  EraseNodeLocked(path);
+  auto p_it = nodes_.find(parent);
+  if (p_it != nodes_.end()) {
+    if (childrens_.find(parent) != childrens_.end()) {
+      std::set<std::string>& children = childrens_[parent];
+      if (children.erase(child)) {
+        Stat* tmp = p_it->second.mutable_stat();
+        tmp->set_children_version(tmp->children_version() + 1);
+        tmp->set_children_num(static_cast<uint32_t>(children.size()));
+        tmp->set_children_id(txn->instance_id());
+      }
+      if (children.empty()) {
+        childrens_.erase(parent);
       }
-      response->set_code(RC_OK);
-    } else {
-      response->set_code(RC_NO_PARENT);
     }
+    response->set_code(RC_OK);
+  } else {
+    response->set_code(RC_NO_PARENT);
   }
 
-  data_watches_.TriggerWatcher(path, ET_NODE_DELETED);
+  triggers->push_back(Trigger(path, ET_NODE_DELETED));
   if (!parent.empty()) {
-    child_watches_.TriggerWatcher(parent, ET_NODE_CHILDREN_CHANGED);
+    triggers->push_back(Trigger(parent, ET_NODE_CHILDREN_CHANGED));
   }
 }
 
-void DataTree::Exists(const ExistsRequest& request, Watcher* watcher,
+void DataTree::EraseNodeLocked(const std::string& path) {
+  auto it = nodes_.find(path);
+  assert(it != nodes_.end());
+  if (it->second.stat().ephemeral_id() != 0) {
+    auto e = ephemerals_.find(it->second.stat().ephemeral_id());
+    if (e != ephemerals_.end()) {
+      e->second.erase(path);
+      if (e->second.empty()) {
+        ephemerals_.erase(e);
+      }
+    }
+  }
+  UpdateStats(path, -1, -static_cast<int64_t>(it->second.data().size()));
+  nodes_.erase(it);
+}
+
+void DataTree::GetDescendantsLocked(const std::string& path,
+                                    std::vector<std::string>* paths) const {
+  size_t begin = paths->size();
+  std::vector<std::string> stack(1, path);
+  while (!stack.empty()) {
+    std::string current = std::move(stack.back());
+    stack.pop_back();
+    auto c = childrens_.find(current);
+    if (c != childrens_.end()) {
+      for (auto& child : c->second) {
+        stack.push_back(current + "/" + child);
+      }
+    }
+    if (current != path) {
+      paths->push_back(std::move(current));
+    }
+  }
+  // Every node is visited before its descendants, so the reversed order
+  // puts the leaves first.
+  std::reverse(paths->begin() + begin, paths->end());
+}
+
+void DataTree::Exists(const ExistsRequest& request, ServerWatcher* watcher,
                       ExistsResponse* response) {
   const std::string& path = request.path();
   std::string parent;
@@ -214,7 +339,8 @@ void DataTree::Exists(const ExistsRequest& request, Watcher* watcher,
     return;
   }
   if (watcher) {
-    data_watches_.AddWatcher(path, watcher);
+    watches_.AddWatcher(path, watcher, ServerWatchManager::kData,
+                        request.with_data());
   }
 
   std::lock_guard<std::mutex> lock(mutex_);
@@ -228,8 +354,46 @@ void DataTree::Exists(const ExistsRequest& request, Watcher* watcher,
   }
 }
 
-void DataTree::GetData(const GetDataRequest& request, Watcher* watcher,
+void DataTree::GetData(const GetDataRequest& request, ServerWatcher* watcher,
                        GetDataResponse* response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  GetDataLocked(request, watcher, response);
+}
+
+void DataTree::MultiGetData(const MultiGetDataRequest& request,
+                            size_t max_size, ServerWatcher* watcher,
+                            MultiGetDataResponse* response) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  // Sized by the stats first, so a large read neither copies the data nor
+  // sets the watches.
+  size_t size = 0;
+  for (const auto& r : request.requests()) {
+    auto it = nodes_.find(r.path());
+    if (it == nodes_.end() ||
+        (r.known_modified_id() != 0 &&
+         r.known_modified_id() == it->second.stat().modified_id())) {
+      continue;
+    }
+    size_t len = it->second.stat().data_len();
+    len = r.offset() < len ? len - r.offset() : 0;
+    if (r.max_size() > 0 && r.max_size() < len) {
+      len = r.max_size();
+    }
+    size += len;
+    if (size > max_size) {
+      response->set_code(RC_TOO_LARGE);
+      return;
+    }
+  }
+  for (const auto& r : request.requests()) {
+    GetDataLocked(r, r.watch() ? watcher : nullptr, response->add_responses());
+  }
+  response->set_code(RC_OK);
+}
+
+void DataTree::GetDataLocked(const GetDataRequest& request,
+                             ServerWatcher* watcher,
+                             GetDataResponse* response) {
   const std::string& path = request.path();
   std::string parent;
   std::string child;
@@ -239,28 +403,133 @@ void DataTree::GetData(const GetDataRequest& request, Watcher* watcher,
     return;
   }
 
+  auto it = nodes_.find(path);
+  if (it == nodes_.end()) {
+    response->set_code(RC_NO_NODE);
+    return;
+  }
+  response->set_node_type(it->second.type());
+  *(response->mutable_stat()) = it->second.stat();
+  if (request.known_modified_id() != 0 &&
+      request.known_modified_id() == it->second.stat().modified_id()) {
+    response->set_code(RC_NOT_MODIFIED);
+  } else {
+    response->set_code(RC_OK);
+    std::string buffer;
+    const std::string& data = GetNodeData(it->second, &buffer);
+    if (request.offset() == 0 && request.max_size() == 0) {
+      response->set_data(data);
+    } else if (request.offset() < data.size()) {
+      size_t size = data.size() - request.offset();
+      if (request.max_size() > 0 && request.max_size() < size) {
+        size = request.max_size();
+      }
+      response->set_data(data.substr(request.offset(), size));
+    }
+  }
+  // Set under the lock, so no write can slip in between the read and it.
+  if (watcher) {
+    watches_.AddWatcher(path, watcher, ServerWatchManager::kData,
+                        request.with_data());
+  }
+}
+
+void DataTree::SetData(const SetDataRequest& request, const Transaction* txn,
+                       SetDataResponse* response, bool only_check) {
+  std::vector<Trigger> triggers;
   {
     std::lock_guard<std::mutex> lock(mutex_);
-    auto it = nodes_.find(path);
-    if (it != nodes_.end()) {
-      response->set_code(RC_OK);
-      response->set_node_type(it->second.type());
-      response->set_data(it->second.data());
-      *(response->mutable_stat()) = it->second.stat();
-    } else {
-      response->set_code(RC_NO_NODE);
+    SetDataLocked(request, txn, response, only_check, &triggers);
+  }
+  Fire(triggers);
+}
+
+void DataTree::SetDataLocked(const SetDataRequest& request,
+                             const Transaction* txn, SetDataResponse* response,
+                             bool only_check, std::vector<Trigger>* triggers) {
+  const std::string& path = request.path();
+  std::string parent;
+  std::string child;
+  ResponseCode retcode = ParsePath(path, &parent, &child);
+  if (retcode != RC_OK) {
+    response->set_code(retcode);
+    return;
+  }
+
+  auto it = nodes_.find(path);
+  if (it == nodes_.end()) {
+    response->set_code(RC_NO_NODE);
+    return;
+  }
+  int version = it->second.stat().version();
+  if (request.version() != -1 && request.version() != version) {
+    response->set_code(RC_BAD_VERSION);
+    return;
+  }
+  const size_t old_size = static_cast<size_t>(it->second.stat().data_len());
+  size_t new_size = request.data().size();
+  if (request.mode() == SM_APPEND) {
+    new_size += old_size;
+  } else if (request.mode() == SM_PATCH) {
+    if (request.offset() > old_size) {
+      response->set_code(RC_BAD_DATA);
+      return;
     }
+    new_size = std::max(old_size, request.offset() + new_size);
+  }
+  // The size of SM_REPLACE is checked by the session, but the result of
+  // the others is only known here, and they may be ops of Multi.
+  if (request.mode() != SM_REPLACE && new_size > kMaxDataSize) {
+    response->set_code(RC_BAD_DATA);
+    return;
+  }
+  if (only_check) {
+    response->set_code(RC_OK);
+    return;
   }
 
-  if (response->code() == RC_OK) {
-    if (watcher) {
-      data_watches_.AddWatcher(path, watcher);
+  Stat* stat = it->second.mutable_stat();
+  stat->set_modified_id(txn->instance_id());
+  stat->set_modified_time(txn->time());
+  stat->set_version(version + 1);
+  stat->set_data_len(static_cast<int>(new_size));
+  const int64_t old_stored = static_cast<int64_t>(it->second.data().size());
+  std::string new_data;
+  if (request.mode() != SM_REPLACE) {
+    std::string buffer;
+    new_data = GetNodeData(it->second, &buffer);
+    if (request.mode() == SM_APPEND) {
+      new_data.append(request.data());
+    } else {
+      new_data.resize(new_size);
+      new_data.replace(request.offset(), request.data().size(),
+                       request.data());
+    }
+  }
+  SetNodeData(request.mode() == SM_REPLACE ? request.data() : new_data,
+              &it->second);
+  UpdateStats(path, 0,
+              static_cast<int64_t>(it->second.data().size()) - old_stored);
+  response->set_code(RC_OK);
+  response->mutable_stat()->CopyFrom(*stat);
+  if (request.mode() == SM_REPLACE) {
+    triggers->push_back(
+        Trigger(path, ET_NODE_DATA_CHANGED, stat, &request.data()));
+  } else {
+    // The event carries the whole new data. It is copied, since a later op
+    // of Multi may remove the node before the trigger fires.
+    triggers->push_back(Trigger(path, ET_NODE_DATA_CHANGED, stat));
+    if (new_size <= ServerWatchManager::kMaxWatchDataSize) {
+      triggers->back().owned =
+          std::make_shared<const std::string>(std::move(new_data));
+      triggers->back().data = triggers->back().owned.get();
     }
   }
 }
 
-void DataTree::SetData(const SetDataRequest& request, const Transaction* txn,
-                       SetDataResponse* response, bool only_check) {
+void DataTree::Increment(const IncrementRequest& request,
+                         const Transaction* txn, IncrementResponse* response,
+                         bool only_check) {
   const std::string& path = request.path();
   std::string parent;
   std::string child;
@@ -270,36 +539,226 @@ void DataTree::SetData(const SetDataRequest& request, const Transaction* txn,
     return;
   }
 
+  // Outlive the lock, the trigger points to it.
+  std::string data;
+  std::vector<Trigger> triggers;
   {
     std::lock_guard<std::mutex> lock(mutex_);
     auto it = nodes_.find(path);
-    if (it != nodes_.end()) {
-      int version = it->second.stat().version();
-      if (request.version() != -1 && request.version() != version) {
-        response->set_code(RC_BAD_VERSION);
-      } else if (only_check) {
-        response->set_code(RC_OK);
-      } else {
-        Stat* stat = it->second.mutable_stat();
-        stat->set_modified_id(txn->instance_id());
-        stat->set_modified_time(txn->time());
-        stat->set_version(version + 1);
-        stat->set_data_len(static_cast<int>(request.data().size()));
-        it->second.set_data(request.data());
-        response->set_code(RC_OK);
-        response->mutable_stat()->CopyFrom(*stat);
-      }
-    } else {
+    if (it == nodes_.end()) {
       response->set_code(RC_NO_NODE);
+      return;
     }
+    int64_t value = 0;
+    std::string buffer;
+    const std::string& old_data = GetNodeData(it->second, &buffer);
+    if (!old_data.empty()) {
+      char* end = nullptr;
+      errno = 0;
+      value = strtoll(old_data.c_str(), &end, 10);
+      if (errno != 0 || end != old_data.c_str() + old_data.size()) {
+        response->set_code(RC_BAD_DATA);
+        return;
+      }
+    }
+    int64_t delta = request.delta();
+    if ((delta > 0 && value > INT64_MAX - delta) ||
+        (delta < 0 && value < INT64_MIN - delta)) {
+      response->set_code(RC_BAD_DATA);
+      return;
+    }
+    value += delta;
+    if (only_check) {
+      response->set_code(RC_OK);
+      return;
+    }
+
+    data = std::to_string(value);
+    Stat* stat = it->second.mutable_stat();
+    stat->set_modified_id(txn->instance_id());
+    stat->set_modified_time(txn->time());
+    stat->set_version(stat->version() + 1);
+    stat->set_data_len(static_cast<int>(data.size()));
+    const int64_t old_stored = static_cast<int64_t>(it->second.data().size());
+    SetNodeData(data, &it->second);
+    UpdateStats(path, 0,
+                static_cast<int64_t>(it->second.data().size()) - old_stored);
+    response->set_code(RC_OK);
+    response->set_value(value);
+    response->mutable_stat()->CopyFrom(*stat);
+    triggers.push_back(Trigger(path, ET_NODE_DATA_CHANGED, stat, &data));
   }
+  Fire(triggers);
+}
 
-  if (!only_check && response->code() == RC_OK) {
-    data_watches_.TriggerWatcher(path, ET_NODE_DATA_CHANGED);
+void DataTree::Multi(const MultiRequest& request, const Transaction* txn,
+                     MultiResponse* response, bool only_check) {
+  // The check runs the ops too, and always rolls them back.
+  Transaction check_txn;
+  if (only_check) {
+    txn = &check_txn;
+  }
+  std::vector<Trigger> triggers;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Undo> undos;
+    ResponseCode code = RC_OK;
+    for (const auto& op : request.ops()) {
+      MultiResult* result = response->add_results();
+      result->set_type(op.type());
+      if (code != RC_OK) {
+        result->set_code(RC_UNKNOWN);
+        continue;
+      }
+      switch (op.type()) {
+        case MT_CREATE: {
+          CreateResponse r;
+          // The created path (with the suffix of a sequential node) didn't
+          // exist before, only the parent is taken before the create.
+          Undo undo;
+          undo.existed = false;
+          GetParentStatLocked(op.create().path(), &undo.parent_stat);
+          CreateLocked(op.create(), txn, &r, false, &triggers);
+          result->set_code(r.code());
+          result->set_path(r.path());
+          if (r.code() == RC_OK) {
+            undo.path = r.path();
+            undos.push_back(std::move(undo));
+          }
+          break;
+        }
+        case MT_DELETE: {
+          DeleteResponse r;
+          if (op.remove().recursive()) {
+            // Undone in reverse, so the parents are restored first.
+            std::vector<std::string> descendants;
+            GetDescendantsLocked(op.remove().path(), &descendants);
+            for (auto& d : descendants) {
+              undos.push_back(MakeUndoLocked(d));
+            }
+          }
+          undos.push_back(MakeUndoLocked(op.remove().path()));
+          DeleteLocked(op.remove(), txn, &r, false, &triggers);
+          result->set_code(r.code());
+          break;
+        }
+        case MT_SETDATA: {
+          SetDataResponse r;
+          undos.push_back(MakeUndoLocked(op.set_data().path()));
+          SetDataLocked(op.set_data(), txn, &r, false, &triggers);
+          result->set_code(r.code());
+          *(result->mutable_stat()) = r.stat();
+          break;
+        }
+        case MT_CHECK: {
+          auto it = nodes_.find(op.check().path());
+          if (it == nodes_.end()) {
+            result->set_code(RC_NO_NODE);
+          } else if (op.check().version() != -1 &&
+                     op.check().version() != it->second.stat().version()) {
+            result->set_code(RC_BAD_VERSION);
+          } else {
+            result->set_code(RC_OK);
+          }
+          break;
+        }
+        default: {
+          result->set_code(RC_FAILED);
+          break;
+        }
+      }
+      if (result->code() != RC_OK) {
+        code = result->code();
+      }
+    }
+    if (code != RC_OK || only_check) {
+      for (auto it = undos.rbegin(); it != undos.rend(); ++it) {
+        UndoLocked(*it);
+      }
+      triggers.clear();
+    }
+    response->set_code(code);
+  }
+  Fire(triggers);
+}
+
+DataTree::Undo DataTree::MakeUndoLocked(const std::string& path) const {
+  Undo undo;
+  undo.path = path;
+  auto it = nodes_.find(path);
+  undo.existed = (it != nodes_.end());
+  if (undo.existed) {
+    undo.node = it->second;
+  }
+  GetParentStatLocked(path, &undo.parent_stat);
+  return undo;
+}
+
+void DataTree::GetParentStatLocked(const std::string& path,
+                                   Stat* stat) const {
+  std::string parent;
+  std::string child;
+  if (ParsePath(path, &parent, &child) == RC_OK) {
+    auto p = nodes_.find(parent);
+    if (p != nodes_.end()) {
+      *stat = p->second.stat();
+    }
   }
 }
 
-void DataTree::GetChildren(const GetChildrenRequest& request, Watcher* watcher,
+void DataTree::UndoLocked(const Undo& undo) {
+  std::string parent;
+  std::string child;
+  if (ParsePath(undo.path, &parent, &child) != RC_OK) {
+    return;
+  }
+  auto it = nodes_.find(undo.path);
+  if (it != nodes_.end()) {
+    uint64_t ephemeral_id = it->second.stat().ephemeral_id();
+    if (ephemeral_id != 0) {
+      auto e = ephemerals_.find(ephemeral_id);
+      if (e != ephemerals_.end()) {
+        e->second.erase(undo.path);
+        if (e->second.empty()) {
+          ephemerals_.erase(e);
+        }
+      }
+    }
+    UpdateStats(undo.path, -1,
+                -static_cast<int64_t>(it->second.data().size()));
+    nodes_.erase(it);
+    auto c = childrens_.find(parent);
+    if (c != childrens_.end()) {
+      c->second.erase(child);
+      if (c->second.empty()) {
+        childrens_.erase(c);
+      }
+    }
+  }
+  if (undo.existed) {
+    nodes_[undo.path] = undo.node;
+    childrens_[parent].insert(child);
+    if (undo.node.stat().ephemeral_id() != 0) {
+      ephemerals_[undo.node.stat().ephemeral_id()].insert(undo.path);
+    }
+    UpdateStats(undo.path, 1, static_cast<int64_t>(undo.node.data().size()));
+  }
+  auto p = nodes_.find(parent);
+  if (p != nodes_.end()) {
+    *(p->second.mutable_stat()) = undo.parent_stat;
+  }
+}
+
+void DataTree::Fire(const std::vector<Trigger>& triggers) {
+  for (auto& trigger : triggers) {
+    watches_.TriggerWatcher(trigger.path, trigger.type,
+                            trigger.has_stat ? &trigger.stat : nullptr,
+                            trigger.data);
+  }
+}
+
+void DataTree::GetChildren(const GetChildrenRequest& request,
+                           ServerWatcher* watcher,
                            GetChildrenResponse* response) {
   const std::string& path = request.path();
   std::string parent;
@@ -315,10 +774,15 @@ void DataTree::GetChildren(const GetChildrenRequest& request, Watcher* watcher,
   if (it != nodes_.end()) {
     response->set_code(RC_OK);
     *(response->mutable_stat()) = it->second.stat();
-    if (childrens_.find(path) != childrens_.end()) {
-      const std::unordered_set<std::string>& children = childrens_[path];
-      for (auto& i : children) {
-        response->add_children(i);
+    auto c = childrens_.find(path);
+    if (c != childrens_.end()) {
+      if (!request.with_nodes() && request.start_after().empty() &&
+          request.max_children() == 0 && request.prefix().empty()) {
+        for (auto& i : c->second) {
+          response->add_children(i);
+        }
+      } else {
+        GetChildrenPageLocked(request, c->second, response);
       }
     }
   } else {
@@ -328,34 +792,329 @@ void DataTree::GetChildren(const GetChildrenRequest& request, Watcher* watcher,
   if (watcher && response->code() == RC_OK) {
     if (it->second.type() != NT_EPHEMERAL &&
         it->second.type() != NT_EPHEMERAL_SEQUENTIAL) {
-      child_watches_.AddWatcher(path, watcher);
+      watches_.AddWatcher(path, watcher, ServerWatchManager::kChild);
     }
   }
 }
 
-void DataTree::RemoveWatcher(Watcher* watcher) {
-  data_watches_.RemoveWatcher(watcher);
-  child_watches_.RemoveWatcher(watcher);
+void DataTree::GetChildrenPageLocked(const GetChildrenRequest& request,
+                                     const std::set<std::string>& children,
+                                     GetChildrenResponse* response) {
+  const std::string& prefix = request.prefix();
+  auto it = request.start_after() < prefix
+                ? children.lower_bound(prefix)
+                : children.upper_bound(request.start_after());
+  uint32_t count = 0;
+  uint64_t data_size = 0;
+  std::string child_path;
+  std::string buffer;
+  for (; it != children.end(); ++it) {
+    const std::string& name = *it;
+    if (name.compare(0, prefix.size(), prefix) != 0) {
+      // The names with the prefix are contiguous in order.
+      it = children.end();
+      break;
+    }
+    if (request.max_children() > 0 && count == request.max_children()) {
+      break;
+    }
+    if (request.with_nodes()) {
+      child_path = request.path() + "/" + name;
+      auto node_it = nodes_.find(child_path);
+      assert(node_it != nodes_.end());
+      if (request.max_data_size() > 0) {
+        data_size += node_it->second.stat().data_len();
+        if (data_size > request.max_data_size() && count > 0) {
+          break;
+        }
+      }
+      ChildNode* node = response->add_nodes();
+      node->set_name(name);
+      *(node->mutable_stat()) = node_it->second.stat();
+      if (request.max_data_size() > 0) {
+        node->set_data(GetNodeData(node_it->second, &buffer));
+      }
+    } else {
+      response->add_children(name);
+    }
+    ++count;
+  }
+  if (it != children.end() &&
+      it->compare(0, prefix.size(), prefix) == 0 && count > 0) {
+    response->set_next_start_after(*std::prev(it));
+  }
 }
 
-void DataTree::KillSession(uint64_t session_id, const Transaction* txn) {
+ResponseCode DataTree::GetSubtree(const std::string& path, bool with_data,
+                                  size_t max_nodes, size_t max_size,
+                                  std::vector<SubtreeNode>* nodes) {
+  std::string parent;
+  std::string child;
+  ResponseCode code = ParsePath(path, &parent, &child);
+  if (code != RC_OK) {
+    return code;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (nodes_.find(path) == nodes_.end()) {
+    return RC_NO_NODE;
+  }
+  std::vector<std::string> stack(1, path);
+  size_t size = 0;
+  while (!stack.empty()) {
+    std::string current = std::move(stack.back());
+    stack.pop_back();
+    auto it = nodes_.find(current);
+    assert(it != nodes_.end());
+    size += current.size();
+    if (with_data) {
+      size += it->second.stat().data_len();
+    }
+    if (nodes->size() >= max_nodes || size > max_size) {
+      nodes->clear();
+      return RC_TOO_LARGE;
+    }
+    nodes->emplace_back();
+    SubtreeNode& node = nodes->back();
+    node.set_node_type(it->second.type());
+    *(node.mutable_stat()) = it->second.stat();
+    if (with_data) {
+      std::string buffer;
+      node.set_data(GetNodeData(it->second, &buffer));
+    }
+    auto c = childrens_.find(current);
+    if (c != childrens_.end()) {
+      // Reversed, so the children are popped in order.
+      for (auto i = c->second.rbegin(); i != c->second.rend(); ++i) {
+        stack.push_back(current + "/" + *i);
+      }
+    }
+    node.set_path(std::move(current));
+  }
+  return RC_OK;
+}
+
+ResponseCode DataTree::WalkSubtree(const std::string& path,
+                                   const std::string& start_after,
+                                   bool with_data, size_t max_size,
+                                   std::vector<SubtreeNode>* nodes,
+                                   bool* done) {
+  std::string parent;
+  std::string child;
+  ResponseCode code = ParsePath(path, &parent, &child);
+  if (code != RC_OK) {
+    return code;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string current;
+  if (start_after.empty()) {
+    if (nodes_.find(path) == nodes_.end()) {
+      return RC_NO_NODE;
+    }
+    current = path;
+  } else {
+    current = NextInSubtreeLocked(path, start_after);
+  }
+  size_t size = 0;
+  while (!current.empty()) {
+    auto it = nodes_.find(current);
+    assert(it != nodes_.end());
+    size += current.size();
+    if (with_data) {
+      size += it->second.stat().data_len();
+    }
+    if (size > max_size && !nodes->empty()) {
+      break;
+    }
+    nodes->emplace_back();
+    SubtreeNode& node = nodes->back();
+    node.set_path(current);
+    node.set_node_type(it->second.type());
+    *(node.mutable_stat()) = it->second.stat();
+    if (with_data) {
+      std::string buffer;
+      node.set_data(GetNodeData(it->second, &buffer));
+    }
+    current = NextInSubtreeLocked(path, current);
+  }
+  *done = current.empty();
+  return RC_OK;
+}
+
+std::string DataTree::NextInSubtreeLocked(const std::string& root,
+                                          std::string path) const {
+  auto c = childrens_.find(path);
+  if (c != childrens_.end() && !c->second.empty()) {
+    return path + "/" + *c->second.begin();
+  }
+  // The next sibling of the path, or of the nearest ancestor which has one.
+  while (path.size() > root.size()) {
+    size_t found = path.find_last_of('/');
+    std::string child = path.substr(found + 1);
+    path.resize(found);
+    c = childrens_.find(path);
+    if (c != childrens_.end()) {
+      auto next = c->second.upper_bound(child);
+      if (next != c->second.end()) {
+        return path + "/" + *next;
+      }
+    }
+  }
+  return std::string();
+}
+
+void DataTree::AddWatch(const AddWatchRequest& request,
+                        ServerWatcher* watcher, AddWatchResponse* response) {
+  std::string parent;
+  std::string child;
+  ResponseCode code = ParsePath(request.path(), &parent, &child);
+  if (code == RC_OK) {
+    watches_.AddWatcher(request.path(), watcher,
+                        request.mode() == WM_PERSISTENT_RECURSIVE
+                            ? ServerWatchManager::kRecursive
+                            : ServerWatchManager::kPersistent,
+                        request.with_data());
+  }
+  response->set_code(code);
+}
+
+void DataTree::RemoveWatch(const RemoveWatchRequest& request,
+                           ServerWatcher* watcher,
+                           RemoveWatchResponse* response) {
+  bool b = watches_.RemoveWatcher(request.path(), watcher,
+                                  request.mode() == WM_PERSISTENT_RECURSIVE
+                                      ? ServerWatchManager::kRecursive
+                                      : ServerWatchManager::kPersistent);
+  response->set_code(b ? RC_OK : RC_NO_WATCHER);
+}
+
+void DataTree::SetWatches(const SetWatchesRequest& request,
+                          ServerWatcher* watcher,
+                          SetWatchesResponse* response) {
+  std::string parent;
+  std::string child;
+  std::vector<WatchedEvent> events;
+  {
+    // Hold the lock while re-registering, so a change is either seen here
+    // or triggers the watch later.
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& watch : request.data_watches()) {
+      if (ParsePath(watch.path(), &parent, &child) != RC_OK) {
+        continue;
+      }
+      auto it = nodes_.find(watch.path());
+      EventType type = ET_NONE;
+      if (it == nodes_.end()) {
+        if (watch.id() != 0) {
+          type = ET_NODE_DELETED;
+        }
+      } else if (watch.id() == 0) {
+        type = ET_NODE_CREATED;
+      } else if (it->second.stat().modified_id() != watch.id()) {
+        type = ET_NODE_DATA_CHANGED;
+      }
+      if (type == ET_NONE) {
+        watches_.AddWatcher(watch.path(), watcher, ServerWatchManager::kData,
+                            watch.with_data());
+        continue;
+      }
+      events.push_back(WatchedEvent());
+      WatchedEvent& event = events.back();
+      event.set_state(SS_CONNECTED);
+      event.set_type(type);
+      event.set_path(watch.path());
+      if (watch.with_data() && it != nodes_.end()) {
+        *(event.mutable_stat()) = it->second.stat();
+        if (it->second.stat().data_len() <=
+            ServerWatchManager::kMaxWatchDataSize) {
+          std::string buffer;
+          event.set_data(GetNodeData(it->second, &buffer));
+          event.set_has_data(true);
+        }
+      }
+    }
+    for (const auto& watch : request.child_watches()) {
+      if (ParsePath(watch.path(), &parent, &child) != RC_OK) {
+        continue;
+      }
+      auto it = nodes_.find(watch.path());
+      if (it != nodes_.end() &&
+          it->second.stat().children_id() == watch.id()) {
+        watches_.AddWatcher(watch.path(), watcher, ServerWatchManager::kChild);
+        continue;
+      }
+      events.push_back(WatchedEvent());
+      events.back().set_state(SS_CONNECTED);
+      events.back().set_type(it == nodes_.end() ? ET_NODE_DELETED
+                                                : ET_NODE_CHILDREN_CHANGED);
+      events.back().set_path(watch.path());
+    }
+  }
+  for (const auto& watch : request.persistent_watches()) {
+    if (ParsePath(watch.path(), &parent, &child) != RC_OK) {
+      continue;
+    }
+    watches_.AddWatcher(watch.path(), watcher,
+                        watch.mode() == WM_PERSISTENT_RECURSIVE
+                            ? ServerWatchManager::kRecursive
+                            : ServerWatchManager::kPersistent,
+                        watch.with_data());
+  }
+  for (auto& event : events) {
+    watcher->Process(event);
+  }
+  response->set_code(RC_OK);
+}
+
+void DataTree::RemoveWatcher(ServerWatcher* watcher) {
+  watches_.RemoveWatcher(watcher);
+}
+
+void DataTree::GetStats(NodeStats* total,
+                        std::map<std::string, NodeStats>* roots,
+                        WatchStats* watches) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    *total = total_stats_;
+    roots->insert(root_stats_.begin(), root_stats_.end());
+  }
+  for (int i = 0; i < ServerWatchManager::kWatchTypeSize; ++i) {
+    watches_.GetStats(static_cast<ServerWatchManager::WatchType>(i),
+                      &watches[i]);
+  }
+}
+
+void DataTree::GetEphemerals(uint64_t session_id,
+                             std::vector<std::string>* paths) {
+  std::lock_guard<std::mutex> lock(mutex_);
   auto it = ephemerals_.find(session_id);
   if (it != ephemerals_.end()) {
-    std::unordered_set<std::string> paths;
-    paths.swap(it->second);
-    ephemerals_.erase(it);
-    DeleteRequest request;
-    DeleteResponse response;
-    for (auto& p : paths) {
-      request.set_path(p);
-      request.set_version(-1);
-      Delete(request, txn, &response);
-      if (response.code() != RC_OK) {
-        LOG_WARN(
-            "Ignoring not RC_OK for path %s while removing ephemeral "
-            "for dead session %llu.",
-            p.c_str(), (unsigned long long)session_id);
-      }
+    paths->insert(paths->end(), it->second.begin(), it->second.end());
+  }
+}
+
+void DataTree::KillSession(uint64_t session_id, const Transaction* txn) {
+  std::unordered_set<std::string> paths;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = ephemerals_.find(session_id);
+    if (it != ephemerals_.end()) {
+      paths.swap(it->second);
+      ephemerals_.erase(it);
+    }
+  }
+  DeleteRequest request;
+  DeleteResponse response;
+  for (auto& p : paths) {
+    request.set_path(p);
+    request.set_version(-1);
+    Delete(request, txn, &response);
+    if (response.code() != RC_OK) {
+      LOG_WARN(
+          "Ignoring not RC_OK for path %s while removing ephemeral "
+          "for dead session %llu.",
+          p.c_str(), (unsigned long long)session_id);
     }
   }
 }
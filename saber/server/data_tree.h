@@ -5,10 +5,14 @@
 #ifndef SABER_SERVER_DATA_TREE_H_
 #define SABER_SERVER_DATA_TREE_H_
 
+#include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include "saber/proto/saber.pb.h"
 #include "saber/proto/server.pb.h"
@@ -16,9 +20,25 @@
 
 namespace saber {
 
+struct NodeStats {
+  uint64_t node_count;
+  uint64_t data_size;
+
+  NodeStats() : node_count(0), data_size(0) {}
+};
+
 class DataTree {
  public:
-  DataTree();
+  // The data of a node is kept compressed if it is at least the threshold
+  // and gets smaller, zero means never. It is uncompressed on every read,
+  // and the Stat (data_len) and the events always see the whole data.
+  static uint32_t kCompressThreshold;
+
+  // The max_data_size of the server, the max data size of a node after
+  // SM_APPEND or SM_PATCH. It is checked both before proposing and when
+  // applied (such as inside Multi), so all the servers of a group must have
+  // the same max_data_size.
+  explicit DataTree(uint32_t max_data_size);
   ~DataTree();
 
   void Recover(const DataNodeList& node_list);
@@ -30,32 +50,155 @@ class DataTree {
   void Delete(const DeleteRequest& request, const Transaction* txn,
               DeleteResponse* response, bool only_check = false);
 
-  void Exists(const ExistsRequest& request, Watcher* watcher,
+  void Exists(const ExistsRequest& request, ServerWatcher* watcher,
               ExistsResponse* response);
 
-  void GetData(const GetDataRequest& request, Watcher* watcher,
+  void GetData(const GetDataRequest& request, ServerWatcher* watcher,
                GetDataResponse* response);
 
   void SetData(const SetDataRequest& request, const Transaction* txn,
                SetDataResponse* response, bool only_check = false);
 
-  void GetChildren(const GetChildrenRequest& request, Watcher* watcher,
+  // All the reads are done under one lock. The watcher is only set for the
+  // requests with watch. RC_TOO_LARGE (and nothing read or watched) if the
+  // data to read is more than max_size bytes.
+  void MultiGetData(const MultiGetDataRequest& request, size_t max_size,
+                    ServerWatcher* watcher, MultiGetDataResponse* response);
+
+  void Increment(const IncrementRequest& request, const Transaction* txn,
+                 IncrementResponse* response, bool only_check = false);
+
+  void GetChildren(const GetChildrenRequest& request, ServerWatcher* watcher,
                    GetChildrenResponse* response);
 
-  void RemoveWatcher(Watcher* watcher);
+  // All or nothing, see MultiRequest.
+  void Multi(const MultiRequest& request, const Transaction* txn,
+             MultiResponse* response, bool only_check = false);
+
+  // Copy the node of the path and all its descendants in pre-order, the
+  // data is copied if with_data. RC_TOO_LARGE (and no nodes) if they are
+  // more than max_nodes, or their paths and data more than max_size bytes.
+  ResponseCode GetSubtree(const std::string& path, bool with_data,
+                          size_t max_nodes, size_t max_size,
+                          std::vector<SubtreeNode>* nodes);
+
+  // Read the next nodes of the subtree of the path in pre-order under one
+  // lock, from the node after start_after (the path itself if it is empty),
+  // until their paths and data are over max_size bytes (at least one node
+  // is read). *done is set if no node is left. The walk resumes by the key,
+  // so start_after needn't still exist.
+  ResponseCode WalkSubtree(const std::string& path,
+                           const std::string& start_after, bool with_data,
+                           size_t max_size, std::vector<SubtreeNode>* nodes,
+                           bool* done);
+
+  void AddWatch(const AddWatchRequest& request, ServerWatcher* watcher,
+                AddWatchResponse* response);
+
+  void RemoveWatch(const RemoveWatchRequest& request, ServerWatcher* watcher,
+                   RemoveWatchResponse* response);
+
+  // Re-register the watches of a reconnected session, the one-shot watches
+  // whose node has changed since the ids seen by the client are fired
+  // instead.
+  void SetWatches(const SetWatchesRequest& request, ServerWatcher* watcher,
+                  SetWatchesResponse* response);
+
+  void RemoveWatcher(ServerWatcher* watcher);
+
+  // The paths of the ephemeral nodes of the session.
+  void GetEphemerals(uint64_t session_id, std::vector<std::string>* paths);
 
   void KillSession(uint64_t session_id, const Transaction* txn);
 
+  // The node count and data size of the whole tree and of every root, and
+  // the watches (an array of ServerWatchManager::kWatchTypeSize).
+  void GetStats(NodeStats* total, std::map<std::string, NodeStats>* roots,
+                WatchStats* watches);
+
  private:
+  // A watch event of a write, which is triggered after the lock is released.
+  struct Trigger {
+    std::string path;
+    EventType type;
+    bool has_stat;
+    Stat stat;
+    // Point to the data of the request, or to owned.
+    const std::string* data;
+    // The whole new data of SM_APPEND and SM_PATCH.
+    std::shared_ptr<const std::string> owned;
+
+    Trigger(const std::string& p, EventType t, const Stat* s = nullptr,
+            const std::string* d = nullptr)
+        : path(p), type(t), has_stat(s != nullptr), data(d) {
+      if (s) {
+        stat = *s;
+      }
+    }
+  };
+
+  // The state of a path and its parent before an op of Multi.
+  struct Undo {
+    std::string path;
+    bool existed;
+    DataNode node;
+    Stat parent_stat;
+  };
+
+  // The data of the node, uncompressed into *buffer if needed.
+  static const std::string& GetNodeData(const DataNode& node,
+                                        std::string* buffer);
+  static void SetNodeData(const std::string& data, DataNode* node);
+
   ResponseCode ParsePath(const std::string& path,
                          std::string* parent, std::string* child) const;
+  void UpdateStats(const std::string& path, int64_t node_count,
+                   int64_t data_size);
+
+  // REQUIRES: mutex_ held.
+  void GetDataLocked(const GetDataRequest& request, ServerWatcher* watcher,
+                     GetDataResponse* response);
+  void CreateLocked(const CreateRequest& request, const Transaction* txn,
+                    CreateResponse* response, bool only_check,
+                    std::vector<Trigger>* triggers);
+  void DeleteLocked(const DeleteRequest& request, const Transaction* txn,
+                    DeleteResponse* response, bool only_check,
+                    std::vector<Trigger>* triggers);
+  void SetDataLocked(const SetDataRequest& request, const Transaction* txn,
+                     SetDataResponse* response, bool only_check,
+                     std::vector<Trigger>* triggers);
+  // The page of GetChildren with paging, prefix or with_nodes.
+  void GetChildrenPageLocked(const GetChildrenRequest& request,
+                             const std::set<std::string>& children,
+                             GetChildrenResponse* response);
+  // Remove the node from nodes_, ephemerals_ and the stats, but not from
+  // childrens_.
+  void EraseNodeLocked(const std::string& path);
+  // Append the paths of all the descendants, the leaves first.
+  void GetDescendantsLocked(const std::string& path,
+                            std::vector<std::string>* paths) const;
+  // The path after the given one in the pre-order of the subtree of root,
+  // or empty if there is none.
+  std::string NextInSubtreeLocked(const std::string& root,
+                                  std::string path) const;
+  Undo MakeUndoLocked(const std::string& path) const;
+  void GetParentStatLocked(const std::string& path, Stat* stat) const;
+  void UndoLocked(const Undo& undo);
+
+  void Fire(const std::vector<Trigger>& triggers);
+
+  const uint32_t kMaxDataSize;
+
   std::mutex mutex_;
   std::unordered_map<std::string, DataNode> nodes_;
-  std::unordered_map<std::string, std::unordered_set<std::string>> childrens_;
+  // Ordered, so GetChildren is sorted and a page is found by a lookup.
+  std::unordered_map<std::string, std::set<std::string>> childrens_;
   std::unordered_map<uint64_t, std::unordered_set<std::string>> ephemerals_;
 
-  ServerWatchManager data_watches_;
-  ServerWatchManager child_watches_;
+  NodeStats total_stats_;
+  std::unordered_map<std::string, NodeStats> root_stats_;
+
+  ServerWatchManager watches_;
 
   // No copying allowed
   DataTree(const DataTree&);
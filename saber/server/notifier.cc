@@ -0,0 +1,79 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/server/notifier.h"
+
+namespace saber {
+
+Notifier::Notifier() {}
+
+Notifier::~Notifier() {}
+
+Notifier::Queue* Notifier::GetQueue(voyager::EventLoop* loop) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<Queue>& queue = queues_[loop];
+  if (!queue) {
+    queue.reset(new Queue());
+  }
+  return queue.get();
+}
+
+void Notifier::Notify(
+    const voyager::TcpConnectionPtr& p,
+    const std::shared_ptr<const SaberMessage>& notification) {
+  voyager::EventLoop* loop = p->OwnerEventLoop();
+  Queue* queue = GetQueue(loop);
+  bool wakeup = false;
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    wakeup = queue->items.empty();
+    queue->items.push_back(std::make_pair(p, notification));
+  }
+  // Only the first one of a batch wakes up the loop, the others are sent
+  // by the same Flush.
+  if (wakeup) {
+    loop->QueueInLoop([this, queue]() { Flush(queue); });
+  }
+}
+
+void Notifier::Flush(Queue* queue) {
+  std::vector<Item> items;
+  {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    items.swap(queue->items);
+  }
+
+  // Group by the connection, and keep the order of the notifications.
+  std::vector<std::pair<voyager::TcpConnection*, std::vector<size_t>>> groups;
+  std::unordered_map<voyager::TcpConnection*, size_t> index;
+  for (size_t i = 0; i < items.size(); ++i) {
+    voyager::TcpConnection* p = items[i].first.get();
+    auto it = index.find(p);
+    if (it == index.end()) {
+      index[p] = groups.size();
+      groups.push_back(std::make_pair(p, std::vector<size_t>(1, i)));
+    } else {
+      groups[it->second].second.push_back(i);
+    }
+  }
+
+  for (auto& group : groups) {
+    const std::vector<size_t>& v = group.second;
+    const voyager::TcpConnectionPtr& p = items[v[0]].first;
+    if (v.size() == 1) {
+      codec_.SendMessage(p, *items[v[0]].second);
+    } else {
+      NotificationBatch batch;
+      for (size_t i : v) {
+        batch.add_events(items[i].second->data());
+      }
+      SaberMessage message;
+      message.set_type(MT_NOTIFICATION_BATCH);
+      batch.SerializeToString(message.mutable_data());
+      codec_.SendMessage(p, message);
+    }
+  }
+}
+
+}  // namespace saber
@@ -0,0 +1,59 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_SERVER_NOTIFIER_H_
+#define SABER_SERVER_NOTIFIER_H_
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <voyager/core/eventloop.h>
+#include <voyager/core/tcp_connection.h>
+#include <voyager/protobuf/protobuf_codec.h>
+
+#include "saber/proto/saber.pb.h"
+
+namespace saber {
+
+// Queue the notifications to the owner event loop of the connections. The
+// caller (such as the apply thread) only enqueues, and every loop sends the
+// queued notifications of a connection in one write, several notifications
+// are merged into one MT_NOTIFICATION_BATCH message.
+class Notifier {
+ public:
+  Notifier();
+  ~Notifier();
+
+  void Notify(const voyager::TcpConnectionPtr& p,
+              const std::shared_ptr<const SaberMessage>& notification);
+
+ private:
+  typedef std::pair<voyager::TcpConnectionPtr,
+                    std::shared_ptr<const SaberMessage>>
+      Item;
+
+  struct Queue {
+    std::mutex mutex;
+    std::vector<Item> items;
+  };
+
+  Queue* GetQueue(voyager::EventLoop* loop);
+  void Flush(Queue* queue);
+
+  voyager::ProtobufCodec<SaberMessage> codec_;
+
+  std::mutex mutex_;
+  std::unordered_map<voyager::EventLoop*, std::unique_ptr<Queue>> queues_;
+
+  // No copying allowed
+  Notifier(const Notifier&);
+  void operator=(const Notifier&);
+};
+
+}  // namespace saber
+
+#endif  // SABER_SERVER_NOTIFIER_H_
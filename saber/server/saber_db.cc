@@ -4,12 +4,16 @@
 
 #include "saber/server/saber_db.h"
 #include "saber/util/logging.h"
+#include "saber/util/timeops.h"
 
 namespace saber {
 
-SaberDB::SaberDB(RunLoop* loop, const ServerOptions& options) : loop_(loop) {
+SaberDB::SaberDB(RunLoop* loop, const ServerOptions& options,
+                 ServerMetrics* metrics, Tracer* tracer)
+    : loop_(loop), metrics_(metrics), tracer_(tracer) {
   for (uint32_t i = 0; i < options.paxos_group_size; ++i) {
-    trees_.push_back(std::unique_ptr<DataTree>(new DataTree()));
+    trees_.push_back(
+        std::unique_ptr<DataTree>(new DataTree(options.max_data_size)));
     sessions_.push_back(std::unique_ptr<SessionManager>(new SessionManager()));
   }
 }
@@ -77,12 +81,12 @@ void SaberDB::Delete(uint32_t group_id, const DeleteRequest& request,
 }
 
 void SaberDB::Exists(uint32_t group_id, const ExistsRequest& request,
-                     Watcher* watcher, ExistsResponse* response) const {
+                     ServerWatcher* watcher, ExistsResponse* response) const {
   trees_[group_id]->Exists(request, watcher, response);
 }
 
 void SaberDB::GetData(uint32_t group_id, const GetDataRequest& request,
-                      Watcher* watcher, GetDataResponse* response) const {
+                      ServerWatcher* watcher, GetDataResponse* response) const {
   trees_[group_id]->GetData(request, watcher, response);
 }
 
@@ -91,12 +95,47 @@ void SaberDB::SetData(uint32_t group_id, const SetDataRequest& request,
   trees_[group_id]->SetData(request, txn, response);
 }
 
+void SaberDB::Multi(uint32_t group_id, const MultiRequest& request,
+                    const Transaction* txn, MultiResponse* response) const {
+  trees_[group_id]->Multi(request, txn, response);
+}
+
+void SaberDB::Increment(uint32_t group_id, const IncrementRequest& request,
+                        const Transaction* txn,
+                        IncrementResponse* response) const {
+  trees_[group_id]->Increment(request, txn, response);
+}
+
 void SaberDB::GetChildren(uint32_t group_id, const GetChildrenRequest& request,
-                          Watcher* watcher,
+                          ServerWatcher* watcher,
                           GetChildrenResponse* response) const {
   trees_[group_id]->GetChildren(request, watcher, response);
 }
 
+void SaberDB::MultiGetData(uint32_t group_id,
+                           const MultiGetDataRequest& request,
+                           size_t max_size, ServerWatcher* watcher,
+                           MultiGetDataResponse* response) const {
+  trees_[group_id]->MultiGetData(request, max_size, watcher, response);
+}
+
+ResponseCode SaberDB::GetSubtree(uint32_t group_id, const std::string& path,
+                                 bool with_data, size_t max_nodes,
+                                 size_t max_size,
+                                 std::vector<SubtreeNode>* nodes) const {
+  return trees_[group_id]->GetSubtree(path, with_data, max_nodes, max_size,
+                                      nodes);
+}
+
+ResponseCode SaberDB::WalkSubtree(uint32_t group_id, const std::string& path,
+                                  const std::string& start_after,
+                                  bool with_data, size_t max_size,
+                                  std::vector<SubtreeNode>* nodes,
+                                  bool* done) const {
+  return trees_[group_id]->WalkSubtree(path, start_after, with_data, max_size,
+                                       nodes, done);
+}
+
 void SaberDB::CheckCreate(uint32_t group_id, const CreateRequest& request,
                           CreateResponse* response) const {
   trees_[group_id]->Create(request, nullptr, response, true);
@@ -112,7 +151,36 @@ void SaberDB::CheckSetData(uint32_t group_id, const SetDataRequest& request,
   trees_[group_id]->SetData(request, nullptr, response, true);
 }
 
-void SaberDB::RemoveWatcher(uint32_t group_id, Watcher* watcher) const {
+void SaberDB::CheckIncrement(uint32_t group_id,
+                             const IncrementRequest& request,
+                             IncrementResponse* response) const {
+  trees_[group_id]->Increment(request, nullptr, response, true);
+}
+
+void SaberDB::CheckMulti(uint32_t group_id, const MultiRequest& request,
+                         MultiResponse* response) const {
+  trees_[group_id]->Multi(request, nullptr, response, true);
+}
+
+void SaberDB::AddWatch(uint32_t group_id, const AddWatchRequest& request,
+                       ServerWatcher* watcher,
+                       AddWatchResponse* response) const {
+  trees_[group_id]->AddWatch(request, watcher, response);
+}
+
+void SaberDB::RemoveWatch(uint32_t group_id, const RemoveWatchRequest& request,
+                          ServerWatcher* watcher,
+                          RemoveWatchResponse* response) const {
+  trees_[group_id]->RemoveWatch(request, watcher, response);
+}
+
+void SaberDB::SetWatches(uint32_t group_id, const SetWatchesRequest& request,
+                         ServerWatcher* watcher,
+                         SetWatchesResponse* response) const {
+  trees_[group_id]->SetWatches(request, watcher, response);
+}
+
+void SaberDB::RemoveWatcher(uint32_t group_id, ServerWatcher* watcher) const {
   trees_[group_id]->RemoveWatcher(watcher);
 }
 
@@ -131,6 +199,16 @@ std::unordered_map<uint64_t, uint64_t> SaberDB::CopySessions(
   return sessions_[group_id]->CopySessions();
 }
 
+size_t SaberDB::GetSessionSize(uint32_t group_id) const {
+  return sessions_[group_id]->GetSize();
+}
+
+void SaberDB::GetStats(uint32_t group_id, NodeStats* total,
+                       std::map<std::string, NodeStats>* roots,
+                       WatchStats* watches) const {
+  trees_[group_id]->GetStats(total, roots, watches);
+}
+
 bool SaberDB::CreateSession(uint32_t group_id, uint64_t session_id,
                             uint64_t new_version, uint64_t old_version) const {
   return sessions_[group_id]->CreateSession(session_id, new_version,
@@ -149,15 +227,18 @@ void SaberDB::KillSession(uint32_t group_id, uint64_t session_id,
 
 bool SaberDB::Execute(uint32_t group_id, uint64_t instance_id,
                       const std::string& value, void* context) {
+  uint64_t start = NowMicros();
   SaberMessage message;
   message.ParseFromString(value);
   Transaction txn;
   txn.ParseFromString(message.extra_data());
   txn.set_group_id(group_id);
   txn.set_instance_id(instance_id);
+  ProposeContext* propose_context = nullptr;
   SaberMessage* reply_message = nullptr;
   if (context) {
-    reply_message = reinterpret_cast<SaberMessage*>(context);
+    propose_context = reinterpret_cast<ProposeContext*>(context);
+    reply_message = propose_context->reply;
     assert(message.type() == reply_message->type());
   }
   switch (message.type()) {
@@ -214,12 +295,47 @@ bool SaberDB::Execute(uint32_t group_id, uint64_t instance_id,
       }
       break;
     }
+    case MT_MULTI: {
+      MultiRequest request;
+      MultiResponse response;
+      request.ParseFromString(message.data());
+      Multi(group_id, request, &txn, &response);
+      if (reply_message) {
+        reply_message->set_data(response.SerializeAsString());
+      }
+      break;
+    }
+    case MT_INCREMENT: {
+      IncrementRequest request;
+      IncrementResponse response;
+      request.ParseFromString(message.data());
+      Increment(group_id, request, &txn, &response);
+      if (reply_message) {
+        reply_message->set_data(response.SerializeAsString());
+      }
+      break;
+    }
     default: {
       LOG_ERROR("Invalid message type.");
       return false;
       break;
     }
   }
+  uint64_t now = NowMicros();
+  metrics_->Record(ServerMetrics::kExecute, message.type(), group_id,
+                   now - start);
+  if (propose_context) {
+    propose_context->execute_start = start;
+    propose_context->execute_end = now;
+  }
+  if (message.trace_id() != 0) {
+    Trace trace;
+    trace.Reset(message.trace_id(), Trace::kExecute, message.type(), group_id,
+                txn.session_id());
+    trace.points[Trace::kExecuting] = start;
+    trace.points[Trace::kExecuted] = now;
+    tracer_->Add(trace);
+  }
   return true;
 }
 
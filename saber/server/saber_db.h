@@ -18,25 +18,52 @@
 
 #include "saber/proto/server.pb.h"
 #include "saber/server/data_tree.h"
+#include "saber/server/server_metrics.h"
 #include "saber/server/server_options.h"
 #include "saber/server/session_manager.h"
+#include "saber/server/tracer.h"
 #include "saber/util/runloop.h"
 
 namespace saber {
 
+// The context of the proposals from this server. Execute fills the reply
+// and records the apply time.
+struct ProposeContext {
+  explicit ProposeContext(SaberMessage* m)
+      : reply(m), execute_start(0), execute_end(0) {}
+
+  SaberMessage* reply;
+  uint64_t execute_start;
+  uint64_t execute_end;
+};
+
 class SaberDB : public skywalker::StateMachine {
  public:
-  SaberDB(RunLoop* loop, const ServerOptions& options);
+  SaberDB(RunLoop* loop, const ServerOptions& options, ServerMetrics* metrics,
+          Tracer* tracer);
   virtual ~SaberDB();
 
-  void Exists(uint32_t group_id, const ExistsRequest& request, Watcher* watcher,
-              ExistsResponse* response) const;
+  void Exists(uint32_t group_id, const ExistsRequest& request,
+              ServerWatcher* watcher, ExistsResponse* response) const;
 
   void GetData(uint32_t group_id, const GetDataRequest& request,
-               Watcher* watcher, GetDataResponse* response) const;
+               ServerWatcher* watcher, GetDataResponse* response) const;
 
   void GetChildren(uint32_t group_id, const GetChildrenRequest& request,
-                   Watcher* watcher, GetChildrenResponse* response) const;
+                   ServerWatcher* watcher, GetChildrenResponse* response) const;
+
+  void MultiGetData(uint32_t group_id, const MultiGetDataRequest& request,
+                    size_t max_size, ServerWatcher* watcher,
+                    MultiGetDataResponse* response) const;
+
+  ResponseCode GetSubtree(uint32_t group_id, const std::string& path,
+                          bool with_data, size_t max_nodes, size_t max_size,
+                          std::vector<SubtreeNode>* nodes) const;
+
+  ResponseCode WalkSubtree(uint32_t group_id, const std::string& path,
+                           const std::string& start_after, bool with_data,
+                           size_t max_size, std::vector<SubtreeNode>* nodes,
+                           bool* done) const;
 
   void CheckCreate(uint32_t group_id, const CreateRequest& request,
                    CreateResponse* response) const;
@@ -47,7 +74,22 @@ class SaberDB : public skywalker::StateMachine {
   void CheckSetData(uint32_t group_id, const SetDataRequest& request,
                     SetDataResponse* response) const;
 
-  void RemoveWatcher(uint32_t group_id, Watcher* watcher) const;
+  void CheckMulti(uint32_t group_id, const MultiRequest& request,
+                  MultiResponse* response) const;
+
+  void CheckIncrement(uint32_t group_id, const IncrementRequest& request,
+                      IncrementResponse* response) const;
+
+  void AddWatch(uint32_t group_id, const AddWatchRequest& request,
+                ServerWatcher* watcher, AddWatchResponse* response) const;
+
+  void RemoveWatch(uint32_t group_id, const RemoveWatchRequest& request,
+                   ServerWatcher* watcher, RemoveWatchResponse* response) const;
+
+  void SetWatches(uint32_t group_id, const SetWatchesRequest& request,
+                  ServerWatcher* watcher, SetWatchesResponse* response) const;
+
+  void RemoveWatcher(uint32_t group_id, ServerWatcher* watcher) const;
 
   bool FindSession(uint32_t group_id, uint64_t session_id,
                    uint64_t* version) const;
@@ -57,6 +99,12 @@ class SaberDB : public skywalker::StateMachine {
 
   std::unordered_map<uint64_t, uint64_t> CopySessions(uint32_t group_id) const;
 
+  size_t GetSessionSize(uint32_t group_id) const;
+
+  void GetStats(uint32_t group_id, NodeStats* total,
+                std::map<std::string, NodeStats>* roots,
+                WatchStats* watches) const;
+
   virtual bool Recover(uint32_t group_id, uint64_t instance_id,
                        const std::string& dir);
 
@@ -83,6 +131,12 @@ class SaberDB : public skywalker::StateMachine {
   void SetData(uint32_t group_id, const SetDataRequest& request,
                const Transaction* txn, SetDataResponse* response) const;
 
+  void Multi(uint32_t group_id, const MultiRequest& request,
+             const Transaction* txn, MultiResponse* response) const;
+
+  void Increment(uint32_t group_id, const IncrementRequest& request,
+                 const Transaction* txn, IncrementResponse* response) const;
+
   bool CreateSession(uint32_t group_id, uint64_t session_id,
                      uint64_t new_version, uint64_t old_version) const;
   bool CloseSession(uint32_t group_id, uint64_t session_id,
@@ -94,6 +148,8 @@ class SaberDB : public skywalker::StateMachine {
   std::vector<std::unique_ptr<SessionManager>> sessions_;
 
   RunLoop* loop_;
+  ServerMetrics* metrics_;
+  Tracer* tracer_;
 
   // No copying allowed
   SaberDB(const SaberDB&);
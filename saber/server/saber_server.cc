@@ -3,14 +3,51 @@
 // found in the LICENSE file.
 
 #include "saber/server/saber_server.h"
+
+#include <stdio.h>
+
+#include <algorithm>
+
 #include "saber/server/saber_db.h"
 #include "saber/server/saber_session.h"
+#include "saber/util/compression.h"
 #include "saber/util/logging.h"
 #include "saber/util/sequence_number.h"
 #include "saber/util/timeops.h"
 
 namespace saber {
 
+static void AppendJsonString(const std::string& s, std::string* out) {
+  out->push_back('"');
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out->push_back('\\');
+      out->push_back(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out->append(buf);
+    } else {
+      out->push_back(c);
+    }
+  }
+  out->push_back('"');
+}
+
+static void AppendHistogram(const Histogram& h, std::string* out) {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "{\"count\":%llu,\"avg\":%.1f,\"min\":%llu,\"p50\":%llu,"
+           "\"p90\":%llu,\"p99\":%llu,\"p999\":%llu,\"max\":%llu}",
+           (unsigned long long)h.count(), h.Average(),
+           (unsigned long long)h.min(), (unsigned long long)h.Percentile(50),
+           (unsigned long long)h.Percentile(90),
+           (unsigned long long)h.Percentile(99),
+           (unsigned long long)h.Percentile(99.9),
+           (unsigned long long)h.max());
+  out->append(buf);
+}
+
 struct SaberServer::Context {
   explicit Context(const EntryPtr& e) : entry_wp(e) {}
   std::weak_ptr<Entry> entry_wp;
@@ -43,7 +80,11 @@ SaberServer::SaberServer(voyager::EventLoop* loop, const ServerOptions& options)
       idle_ticks_(options_.session_timeout / options_.tick_time),
       mutexes_(options_.paxos_group_size),
       sessions_(options_.paxos_group_size),
+      metrics_(options_.paxos_group_size),
+      tracer_(options_),
       loop_(nullptr),
+      connections_(0),
+      rejected_connections_(0),
       monitor_(options.max_all_connections, options.max_ip_connections),
       server_(loop, voyager::SockAddr(options.my_server_message.host,
                                       options.my_server_message.client_port),
@@ -60,7 +101,7 @@ SaberServer::~SaberServer() {}
 
 bool SaberServer::Start() {
   loop_ = thread_.Loop();
-  db_.reset(new SaberDB(loop_, options_));
+  db_.reset(new SaberDB(loop_, options_, &metrics_, &tracer_));
   db_->set_machine_id(1001);
 
   skywalker::GroupOptions group_options;
@@ -105,6 +146,10 @@ bool SaberServer::Start() {
     node_.reset(node);
 
     SaberSession::kMaxDataSize = options_.max_data_size;
+    SaberSession::kMaxSubtreeNodes = options_.max_subtree_nodes;
+    SaberSession::kMaxSubtreeSize = options_.max_subtree_size;
+    DataTree::kCompressThreshold = options_.compress_threshold;
+    ServerWatchManager::kMaxWatchDataSize = options_.max_watch_data_size;
     for (uint32_t i = 0; i < options_.paxos_group_size; ++i) {
       loop_->QueueInLoop(std::bind(&SaberServer::CleanSessions, this, i));
     }
@@ -135,15 +180,21 @@ bool SaberServer::Start() {
 void SaberServer::OnConnection(const voyager::TcpConnectionPtr& p) {
   bool result = monitor_.OnConnection(p);
   if (result) {
+    ++connections_;
     EntryPtr entry = std::make_shared<Entry>(this, p);
     UpdateBuckets(p, entry);
     p->SetContext(new Context(entry));
+  } else {
+    ++rejected_connections_;
   }
 }
 
 void SaberServer::OnClose(const voyager::TcpConnectionPtr& p) {
   monitor_.OnClose(p);
   Context* context = reinterpret_cast<Context*>(p->Context());
+  if (context) {
+    --connections_;
+  }
   delete context;
 }
 
@@ -193,6 +244,45 @@ void SaberServer::UpdateBuckets(const voyager::TcpConnectionPtr& p,
 
 bool SaberServer::HandleMessage(const EntryPtr& entry,
                                 std::unique_ptr<SaberMessage> message) {
+  if (!MessageType_IsValid(message->type())) {
+    LOG_WARN("Invalid message type %d.", static_cast<int>(message->type()));
+    return false;
+  }
+  if (message->compressed()) {
+    size_t size = message->data().size();
+    uint64_t start = NowMicros();
+    if (!UncompressMessage(SaberSession::MaxUncompressedSize(),
+                           message.get())) {
+      LOG_WARN("The compressed data of the message is corrupted or too big.");
+      return false;
+    }
+    metrics_.Add(ServerMetrics::kCodecMicros, message->type(),
+                 NowMicros() - start);
+    metrics_.Increment(ServerMetrics::kCompressed, message->type());
+    metrics_.Add(ServerMetrics::kRawBytes, message->type(),
+                 message->data().size());
+    metrics_.Add(ServerMetrics::kWireBytes, message->type(), size);
+  }
+
+  // Don't need a session, so the tools can get it without MT_CONNECT.
+  if (message->type() == MT_STATS) {
+    StatsRequest request;
+    StatsResponse response;
+    request.ParseFromString(message->data());
+    if (options_.enable_stats) {
+      response.set_code(RC_OK);
+      response.set_stats(GetStats(request.traces()));
+    } else {
+      response.set_code(RC_FAILED);
+    }
+    message->set_data(response.SerializeAsString());
+    if (entry->session) {
+      entry->session->Compress(message.get());
+    }
+    codec_.SendMessage(entry->conn_wp.lock(), *message);
+    return true;
+  }
+
   if (message->type() != MT_CONNECT) {
     if (entry->session) {
       assert(entry->session->GetTcpConnectionPtr() == entry->conn_wp.lock());
@@ -279,11 +369,16 @@ bool SaberServer::OnConnectRequest(const std::string& root, uint32_t group_id,
   response.set_code(RC_FAILED);
   reply->set_data(response.SerializeAsString());
 
+  ProposeContext* propose_context = new ProposeContext(reply);
   bool b = node_->Propose(
-      group_id, db_->machine_id(), std::move(value), reply,
-      [this, root, group_id, session_id, entry](
+      group_id, db_->machine_id(), std::move(value), propose_context,
+      [this, root, group_id, session_id, entry,
+       coalesce_window = request.coalesce_window(),
+       compress_threshold = request.compress_threshold()](
           uint64_t instance_id, const skywalker::Status& s, void* context) {
-        SaberMessage* r = reinterpret_cast<SaberMessage*>(context);
+        std::unique_ptr<ProposeContext> c(
+            reinterpret_cast<ProposeContext*>(context));
+        SaberMessage* r = c->reply;
         ConnectResponse res;
         res.ParseFromString(r->data());
         if (res.code() != RC_OK) {
@@ -292,6 +387,15 @@ bool SaberServer::OnConnectRequest(const std::string& root, uint32_t group_id,
           if (CreateSession(root, group_id, session_id, instance_id, entry)) {
             res.set_code(RC_RECONNECT);
           }
+          entry->session->set_coalesce_window(coalesce_window);
+          uint32_t threshold = 0;
+          if (compress_threshold > 0 && options_.wire_compress_threshold > 0) {
+            threshold =
+                std::max(compress_threshold, options_.wire_compress_threshold);
+          }
+          entry->session->set_compress_threshold(threshold);
+          res.set_compress_threshold(threshold);
+          res.set_compress_max_size(SaberSession::MaxUncompressedSize());
           res.set_session_id(session_id);
           res.set_timeout(options_.session_timeout);
           r->set_data(res.SerializeAsString());
@@ -302,6 +406,7 @@ bool SaberServer::OnConnectRequest(const std::string& root, uint32_t group_id,
       });
 
   if (!b) {
+    delete propose_context;
     entry->started = false;
     OnConnectResponse(entry, std::unique_ptr<SaberMessage>(reply));
   }
@@ -339,7 +444,9 @@ bool SaberServer::CreateSession(const std::string& root, uint32_t group_id,
     b = false;
     entry->session = std::make_shared<SaberSession>(root, group_id, session_id,
                                                     entry->conn_wp.lock(),
-                                                    db_.get(), node_.get());
+                                                    db_.get(), node_.get(),
+                                                    &metrics_, &tracer_,
+                                                    &notifier_);
     sessions_[group_id].insert(std::make_pair(session_id, entry->session));
   }
   entry->session->set_version(version);
@@ -435,6 +542,129 @@ void SaberServer::NewServers(uint32_t group_id) {
   }
 }
 
+std::string SaberServer::GetStats(bool traces) {
+  if (!node_) {
+    return "{}";
+  }
+  std::string s;
+  char buf[512];
+  snprintf(buf, sizeof(buf),
+           "{\"server_id\":%llu,\"connections\":%d,"
+           "\"rejected_connections\":%llu,\"groups\":[",
+           (unsigned long long)server_id_, connections_.load(),
+           (unsigned long long)rejected_connections_.load());
+  s.append(buf);
+
+  for (uint32_t i = 0; i < options_.paxos_group_size; ++i) {
+    size_t online = 0;
+    size_t pending = 0;
+    {
+      std::lock_guard<std::mutex> lock(mutexes_[i]);
+      for (auto& it : sessions_[i]) {
+        auto session = it.second.lock();
+        if (session) {
+          ++online;
+          pending += session->GetPendingSize();
+        }
+      }
+    }
+    NodeStats total;
+    std::map<std::string, NodeStats> roots;
+    WatchStats watches[ServerWatchManager::kWatchTypeSize];
+    db_->GetStats(i, &total, &roots, watches);
+
+    snprintf(buf, sizeof(buf),
+             "%s{\"id\":%u,\"master\":%s,\"sessions\":%zu,"
+             "\"online_sessions\":%zu,\"pending_messages\":%zu,"
+             "\"nodes\":%llu,\"data_size\":%llu,\"watches\":{",
+             i == 0 ? "" : ",", i, node_->IsMaster(i) ? "true" : "false",
+             db_->GetSessionSize(i), online, pending,
+             (unsigned long long)total.node_count,
+             (unsigned long long)total.data_size);
+    s.append(buf);
+    for (int j = 0; j < ServerWatchManager::kWatchTypeSize; ++j) {
+      snprintf(buf, sizeof(buf),
+               "%s\"%s\":{\"paths\":%llu,\"watches\":%llu}",
+               j == 0 ? "" : ",",
+               ServerWatchManager::WatchTypeName(
+                   static_cast<ServerWatchManager::WatchType>(j)),
+               (unsigned long long)watches[j].path_count,
+               (unsigned long long)watches[j].watch_count);
+      s.append(buf);
+    }
+    s.append("},\"roots\":{");
+    bool first = true;
+    for (auto& root : roots) {
+      if (!first) {
+        s.push_back(',');
+      }
+      first = false;
+      AppendJsonString(root.first, &s);
+      snprintf(buf, sizeof(buf), ":{\"nodes\":%llu,\"data_size\":%llu}",
+               (unsigned long long)root.second.node_count,
+               (unsigned long long)root.second.data_size);
+      s.append(buf);
+    }
+    s.append("},\"latency\":{");
+    for (int j = 0; j < ServerMetrics::kPhaseSize; ++j) {
+      ServerMetrics::Phase phase = static_cast<ServerMetrics::Phase>(j);
+      Histogram h;
+      metrics_.GetByGroup(phase, i, &h);
+      snprintf(buf, sizeof(buf), "%s\"%s\":", j == 0 ? "" : ",",
+               ServerMetrics::PhaseName(phase));
+      s.append(buf);
+      AppendHistogram(h, &s);
+    }
+    s.append("}}");
+  }
+
+  s.append("],\"types\":{");
+  bool first = true;
+  for (int i = 0; i < MessageType_ARRAYSIZE; ++i) {
+    if (!MessageType_IsValid(i)) {
+      continue;
+    }
+    MessageType type = static_cast<MessageType>(i);
+    Histogram h[ServerMetrics::kPhaseSize];
+    uint64_t n = 0;
+    for (int j = 0; j < ServerMetrics::kPhaseSize; ++j) {
+      metrics_.GetByType(static_cast<ServerMetrics::Phase>(j), type, &h[j]);
+      n += h[j].count();
+    }
+    if (n == 0) {
+      continue;
+    }
+    if (!first) {
+      s.push_back(',');
+    }
+    first = false;
+    AppendJsonString(MessageType_Name(type), &s);
+    s.append(":{");
+    for (int j = 0; j < ServerMetrics::kCounterSize; ++j) {
+      ServerMetrics::Counter counter = static_cast<ServerMetrics::Counter>(j);
+      snprintf(buf, sizeof(buf), "\"%s\":%llu,",
+               ServerMetrics::CounterName(counter),
+               (unsigned long long)metrics_.GetCounter(counter, type));
+      s.append(buf);
+    }
+    s.append("\"latency\":{");
+    for (int j = 0; j < ServerMetrics::kPhaseSize; ++j) {
+      snprintf(buf, sizeof(buf), "%s\"%s\":", j == 0 ? "" : ",",
+               ServerMetrics::PhaseName(static_cast<ServerMetrics::Phase>(j)));
+      s.append(buf);
+      AppendHistogram(h[j], &s);
+    }
+    s.append("}}");
+  }
+  s.push_back('}');
+  if (traces) {
+    s.append(",\"traces\":");
+    tracer_.AppendJson(&s);
+  }
+  s.push_back('}');
+  return s;
+}
+
 uint64_t SaberServer::GetNextSessionId() const {
   static SequenceNumber<int> seq_num_(1 << 10);
   return (NowMillis() << 22) | (server_id_ << 10) | seq_num_.GetNext();
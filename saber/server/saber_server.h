@@ -5,6 +5,7 @@
 #ifndef SABER_SERVER_SABER_SERVER_H_
 #define SABER_SERVER_SABER_SERVER_H_
 
+#include <atomic>
 #include <memory>
 #include <string>
 #include <utility>
@@ -23,7 +24,10 @@
 #include <voyager/util/hash.h>
 
 #include "saber/proto/saber.pb.h"
+#include "saber/server/notifier.h"
+#include "saber/server/server_metrics.h"
 #include "saber/server/server_options.h"
+#include "saber/server/tracer.h"
 #include "saber/util/runloop.h"
 #include "saber/util/runloop_thread.h"
 
@@ -41,6 +45,11 @@ class SaberServer {
 
   const skywalker::Node* GetNode() const { return node_.get(); }
 
+  const ServerMetrics* GetMetrics() const { return &metrics_; }
+
+  // The live state of the server in JSON, it is also the reply of MT_STATS.
+  std::string GetStats(bool traces = false);
+
  private:
   struct Context;
   struct Entry;
@@ -92,6 +101,9 @@ class SaberServer {
   std::vector<std::mutex> mutexes_;
   std::vector<SessionMap> sessions_;
 
+  ServerMetrics metrics_;
+  Tracer tracer_;
+  Notifier notifier_;
   std::unique_ptr<SaberDB> db_;
   std::unique_ptr<skywalker::Node> node_;
 
@@ -99,6 +111,8 @@ class SaberServer {
   RunLoopThread thread_;
 
   voyager::ProtobufCodec<SaberMessage> codec_;
+  std::atomic<int> connections_;
+  std::atomic<uint64_t> rejected_connections_;
   voyager::TcpMonitor monitor_;
   voyager::TcpServer server_;
 
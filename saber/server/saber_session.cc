@@ -6,13 +6,18 @@
 
 #include <voyager/core/eventloop.h>
 
+#include "saber/util/compression.h"
 #include "saber/util/logging.h"
 #include "saber/util/timeops.h"
 
 namespace saber {
 
 uint32_t SaberSession::kMaxDataSize = 1024 * 1024;
+uint32_t SaberSession::kMaxSubtreeNodes = 100000;
+uint32_t SaberSession::kMaxSubtreeSize = 64 * 1024 * 1024;
 
+// The paths come from the client, so an invalid one (such as "" or "/")
+// gets a root which never matches.
 static std::string GetRoot(const std::string& path) {
   size_t i = 0;
   for (i = 1; i < path.size(); ++i) {
@@ -20,23 +25,33 @@ static std::string GetRoot(const std::string& path) {
       break;
     }
   }
-  assert(i > 1);
-  return path.substr(0, i);
+  return i > 1 ? path.substr(0, i) : std::string();
 }
 
 SaberSession::SaberSession(const std::string& root, uint32_t group_id,
                            uint64_t session_id,
                            const voyager::TcpConnectionPtr& p, SaberDB* db,
-                           skywalker::Node* node)
+                           skywalker::Node* node, ServerMetrics* metrics,
+                           Tracer* tracer, Notifier* notifier)
     : kRoot(root),
       group_id_(group_id),
       session_id_(session_id),
       version_(0),
+      compress_threshold_(0),
       closed_(false),
       last_finished_(true),
       conn_wp_(p),
       db_(db),
-      node_(node) {}
+      node_(node),
+      metrics_(metrics),
+      tracer_(tracer),
+      notifier_(notifier),
+      coalescer_(std::make_shared<Coalescer>()),
+      propose_time_(0),
+      next_stream_id_(0),
+      reset_streams_(false) {
+  coalescer_->conn_wp = p;
+}
 
 SaberSession::~SaberSession() { db_->RemoveWatcher(group_id_, this); }
 
@@ -45,12 +60,55 @@ void SaberSession::OnConnect(const voyager::TcpConnectionPtr& p) {
   closed_ = false;
   conn_wp_ = p;
   pending_messages_.clear();
+  reset_streams_ = true;
+  std::lock_guard<std::mutex> coalescer_lock(coalescer_->mutex);
+  coalescer_->conn_wp = p;
+}
+
+void SaberSession::set_coalesce_window(uint32_t window) {
+  std::lock_guard<std::mutex> lock(coalescer_->mutex);
+  coalescer_->window = window;
+}
+
+void SaberSession::Compress(SaberMessage* message) {
+  uint32_t threshold = compress_threshold_;
+  size_t size = message->data().size();
+  if (threshold == 0 || size < threshold) {
+    return;
+  }
+  uint64_t start = NowMicros();
+  bool compressed = CompressMessage(threshold, message);
+  metrics_->Add(ServerMetrics::kCodecMicros, message->type(),
+                NowMicros() - start);
+  if (compressed) {
+    metrics_->Increment(ServerMetrics::kCompressed, message->type());
+    metrics_->Add(ServerMetrics::kRawBytes, message->type(), size);
+    metrics_->Add(ServerMetrics::kWireBytes, message->type(),
+                  message->data().size());
+  }
+}
+
+size_t SaberSession::GetPendingSize() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return pending_messages_.size();
 }
 
 bool SaberSession::OnMessage(std::unique_ptr<SaberMessage> message) {
   if (closed_) {
     return false;
   }
+  if (!MessageType_IsValid(message->type())) {
+    LOG_WARN("Group %u: session(id=%llu) sent an invalid message type %d.",
+             group_id_, (unsigned long long)session_id_,
+             static_cast<int>(message->type()));
+    return false;
+  }
+  uint64_t receive_time = NowMicros();
+  metrics_->Increment(ServerMetrics::kReceived, message->type());
+  if (message->trace_id() == 0 && message->type() != MT_PING) {
+    message->set_trace_id(tracer_->Sample());
+  }
+
   // No need to check master when the pending_messages_ is not empty.
   if (message->type() == MT_PING && !pending_messages_.empty()) {
     return true;
@@ -73,19 +131,30 @@ bool SaberSession::OnMessage(std::unique_ptr<SaberMessage> message) {
       if (message->type() == MT_MASTER) {
         pending_messages_.clear();
       }
-      pending_messages_.push_back(std::move(message));
+      pending_messages_.push_back(
+          std::make_pair(receive_time, std::move(message)));
     }
   }
   if (next) {
-    HandleMessage(std::move(message));
+    HandleMessage(receive_time, std::move(message));
   }
   return true;
 }
 
-void SaberSession::HandleMessage(std::unique_ptr<SaberMessage> message) {
+void SaberSession::HandleMessage(uint64_t receive_time,
+                                 std::unique_ptr<SaberMessage> message) {
+  uint64_t now = NowMicros();
+  metrics_->Record(ServerMetrics::kQueue, message->type(), group_id_,
+                   now - receive_time);
+  trace_.Reset(message->trace_id(), Trace::kSession, message->type(),
+               group_id_, session_id_);
+  trace_.points[Trace::kReceived] = receive_time;
+  trace_.points[Trace::kStarted] = now;
+  path_.clear();
   if (message->type() != MT_MASTER && node_->IsMaster(group_id_)) {
     DoIt(std::move(message));
   } else {
+    metrics_->Increment(ServerMetrics::kRedirected, message->type());
     Master master;
     skywalker::Member i;
     uint64_t version;
@@ -100,6 +169,8 @@ void SaberSession::HandleMessage(std::unique_ptr<SaberMessage> message) {
 }
 
 void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
+  uint64_t start = NowMicros();
+  DropSubtreeStreams(start);
   bool done = true;
   switch (message->type()) {
     case MT_PING: {
@@ -109,8 +180,9 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
       ExistsRequest request;
       ExistsResponse response;
       request.ParseFromString(message->data());
+      path_ = request.path();
       assert(GetRoot(request.path()) == kRoot);
-      Watcher* watcher = request.watch() ? this : nullptr;
+      ServerWatcher* watcher = request.watch() ? this : nullptr;
       db_->Exists(group_id_, request, watcher, &response);
       message->set_data(response.SerializeAsString());
       break;
@@ -119,8 +191,9 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
       GetDataRequest request;
       GetDataResponse response;
       request.ParseFromString(message->data());
+      path_ = request.path();
       assert(GetRoot(request.path()) == kRoot);
-      Watcher* watcher = request.watch() ? this : nullptr;
+      ServerWatcher* watcher = request.watch() ? this : nullptr;
       db_->GetData(group_id_, request, watcher, &response);
       message->set_data(response.SerializeAsString());
       break;
@@ -129,16 +202,88 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
       GetChildrenRequest request;
       GetChildrenResponse response;
       request.ParseFromString(message->data());
+      path_ = request.path();
       assert(GetRoot(request.path()) == kRoot);
-      Watcher* watcher = request.watch() ? this : nullptr;
+      if (request.max_data_size() > kMaxDataSize) {
+        request.set_max_data_size(kMaxDataSize);
+      }
+      ServerWatcher* watcher = request.watch() ? this : nullptr;
       db_->GetChildren(group_id_, request, watcher, &response);
       message->set_data(response.SerializeAsString());
       break;
     }
+    case MT_MULTIGETDATA: {
+      MultiGetDataRequest request;
+      MultiGetDataResponse response;
+      request.ParseFromString(message->data());
+      path_.clear();
+      bool ok = request.requests_size() > 0;
+      for (const auto& r : request.requests()) {
+        if (path_.empty()) {
+          path_ = r.path();
+        }
+        if (GetRoot(r.path()) != kRoot) {
+          ok = false;
+          break;
+        }
+      }
+      if (!ok) {
+        response.set_code(RC_FAILED);
+      } else if (request.requests_size() > kMaxMultiGetDataPaths) {
+        response.set_code(RC_TOO_LARGE);
+      } else {
+        db_->MultiGetData(group_id_, request, kMaxDataSize, this, &response);
+      }
+      message->set_data(response.SerializeAsString());
+      break;
+    }
+    case MT_GETSUBTREE: {
+      GetSubtreeRequest request;
+      GetSubtreeResponse response;
+      request.ParseFromString(message->data());
+      path_ = request.path();
+      assert(GetRoot(request.path()) == kRoot);
+      GetSubtree(request, &response);
+      message->set_data(response.SerializeAsString());
+      break;
+    }
+    case MT_ADDWATCH: {
+      AddWatchRequest request;
+      AddWatchResponse response;
+      request.ParseFromString(message->data());
+      path_ = request.path();
+      assert(GetRoot(request.path()) == kRoot);
+      db_->AddWatch(group_id_, request, this, &response);
+      message->set_data(response.SerializeAsString());
+      break;
+    }
+    case MT_REMOVEWATCH: {
+      RemoveWatchRequest request;
+      RemoveWatchResponse response;
+      request.ParseFromString(message->data());
+      path_ = request.path();
+      assert(GetRoot(request.path()) == kRoot);
+      db_->RemoveWatch(group_id_, request, this, &response);
+      message->set_data(response.SerializeAsString());
+      break;
+    }
+    case MT_SETWATCHES: {
+      SetWatchesRequest request;
+      SetWatchesResponse response;
+      request.ParseFromString(message->data());
+      if (CheckSetWatchesRequest(request)) {
+        db_->SetWatches(group_id_, request, this, &response);
+      } else {
+        response.set_code(RC_FAILED);
+      }
+      message->set_data(response.SerializeAsString());
+      break;
+    }
     case MT_CREATE: {
       CreateRequest request;
       CreateResponse response;
       request.ParseFromString(message->data());
+      path_ = request.path();
       if (GetRoot(request.path()) != kRoot) {
         SetFailedState(message.get());
         break;
@@ -155,6 +300,7 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
       DeleteRequest request;
       DeleteResponse response;
       request.ParseFromString(message->data());
+      path_ = request.path();
       if (GetRoot(request.path()) != kRoot) {
         SetFailedState(message.get());
         break;
@@ -171,12 +317,55 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
       SetDataRequest request;
       SetDataResponse response;
       request.ParseFromString(message->data());
+      path_ = request.path();
+      bool merged = request.more() || request.upload_offset() > 0;
       if (GetRoot(request.path()) != kRoot ||
-          request.data().size() > kMaxDataSize) {
+          request.data().size() > kMaxDataSize || !MergeChunks(&request)) {
         SetFailedState(message.get());
         break;
       }
+      if (request.more()) {
+        response.set_code(RC_OK);
+        message->set_data(response.SerializeAsString());
+        break;
+      }
       db_->CheckSetData(group_id_, request, &response);
+      if (response.code() != RC_OK) {
+        message->set_data(response.SerializeAsString());
+      } else {
+        if (merged) {
+          message->set_data(request.SerializeAsString());
+        }
+        done = false;
+      }
+      break;
+    }
+    case MT_INCREMENT: {
+      IncrementRequest request;
+      IncrementResponse response;
+      request.ParseFromString(message->data());
+      path_ = request.path();
+      if (GetRoot(request.path()) != kRoot) {
+        SetFailedState(message.get());
+        break;
+      }
+      db_->CheckIncrement(group_id_, request, &response);
+      if (response.code() != RC_OK) {
+        message->set_data(response.SerializeAsString());
+      } else {
+        done = false;
+      }
+      break;
+    }
+    case MT_MULTI: {
+      MultiRequest request;
+      MultiResponse response;
+      request.ParseFromString(message->data());
+      if (!CheckMultiRequest(request)) {
+        SetFailedState(message.get());
+        break;
+      }
+      db_->CheckMulti(group_id_, request, &response);
       if (response.code() != RC_OK) {
         message->set_data(response.SerializeAsString());
       } else {
@@ -194,6 +383,10 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
       break;
     }
   }
+  uint64_t now = NowMicros();
+  metrics_->Record(ServerMetrics::kCheck, message->type(), group_id_,
+                   now - start);
+  trace_.points[Trace::kChecked] = now;
   if (done) {
     Done(std::move(message));
   } else {
@@ -204,16 +397,25 @@ void SaberSession::DoIt(std::unique_ptr<SaberMessage> message) {
 void SaberSession::Done(std::unique_ptr<SaberMessage> reply_message) {
   voyager::TcpConnectionPtr p = conn_wp_.lock();
   if (reply_message->type() != MT_PING) {
+    Compress(reply_message.get());
+    uint64_t start = NowMicros();
     codec_.SendMessage(p, *reply_message);
+    uint64_t now = NowMicros();
+    metrics_->Record(ServerMetrics::kReply, reply_message->type(), group_id_,
+                     now - start);
+    trace_.points[Trace::kReplied] = now;
+    tracer_->Finish(trace_, path_);
   }
 
+  uint64_t receive_time = 0;
   SaberMessage* next = nullptr;
   {
     std::lock_guard<std::mutex> lock(mutex_);
     if (p && reply_message->type() != MT_MASTER &&
         reply_message->type() != MT_CLOSE) {
       if (!pending_messages_.empty()) {
-        next = pending_messages_.front().release();
+        receive_time = pending_messages_.front().first;
+        next = pending_messages_.front().second.release();
         pending_messages_.pop_front();
       }
     } else {
@@ -229,8 +431,9 @@ void SaberSession::Done(std::unique_ptr<SaberMessage> reply_message) {
   }
   if (next) {
     // FIXME
-    p->OwnerEventLoop()->QueueInLoop(
-        [this, next]() { HandleMessage(std::unique_ptr<SaberMessage>(next)); });
+    p->OwnerEventLoop()->QueueInLoop([this, receive_time, next]() {
+      HandleMessage(receive_time, std::unique_ptr<SaberMessage>(next));
+    });
   }
 }
 
@@ -240,13 +443,18 @@ void SaberSession::Propose(std::unique_ptr<SaberMessage> message) {
   txn.set_time(NowMillis());
   SaberMessage* reply = message.release();
   reply->set_extra_data(txn.SerializeAsString());
+  propose_time_ = NowMicros();
+  trace_.points[Trace::kProposed] = propose_time_;
+  ProposeContext* context = new ProposeContext(reply);
   bool b = node_->Propose(
-      group_id_, db_->machine_id(), reply->SerializeAsString(), reply,
+      group_id_, db_->machine_id(), reply->SerializeAsString(), context,
       std::bind(&SaberSession::WeakCallback,
                 std::weak_ptr<SaberSession>(shared_from_this()),
                 std::placeholders::_1, std::placeholders::_2,
                 std::placeholders::_3));
   if (!b) {
+    delete context;
+    metrics_->Increment(ServerMetrics::kProposeFailed, reply->type());
     SetFailedState(reply);
     reply->clear_extra_data();
     Done(std::unique_ptr<SaberMessage>(reply));
@@ -256,11 +464,23 @@ void SaberSession::Propose(std::unique_ptr<SaberMessage> message) {
 void SaberSession::WeakCallback(std::weak_ptr<SaberSession> session_wp,
                                 uint64_t instance_id,
                                 const skywalker::Status& s, void* context) {
-  SaberMessage* reply_message = reinterpret_cast<SaberMessage*>(context);
-  assert(reply_message);
+  std::unique_ptr<ProposeContext> propose_context(
+      reinterpret_cast<ProposeContext*>(context));
+  assert(propose_context);
+  SaberMessage* reply_message = propose_context->reply;
   std::shared_ptr<SaberSession> session(session_wp.lock());
   if (session) {
+    uint64_t now = NowMicros();
+    session->metrics_->Record(ServerMetrics::kPropose, reply_message->type(),
+                              session->group_id_,
+                              now - session->propose_time_);
+    Trace& trace = session->trace_;
+    trace.points[Trace::kExecuting] = propose_context->execute_start;
+    trace.points[Trace::kExecuted] = propose_context->execute_end;
+    trace.points[Trace::kCommitted] = now;
     if (!s.ok()) {
+      session->metrics_->Increment(ServerMetrics::kProposeFailed,
+                                   reply_message->type());
       SetFailedState(reply_message);
     }
     reply_message->clear_extra_data();
@@ -272,6 +492,179 @@ void SaberSession::WeakCallback(std::weak_ptr<SaberSession> session_wp,
   }
 }
 
+bool SaberSession::CheckSetWatchesRequest(const SetWatchesRequest& request) {
+  for (const auto& watch : request.data_watches()) {
+    if (GetRoot(watch.path()) != kRoot) {
+      return false;
+    }
+  }
+  for (const auto& watch : request.child_watches()) {
+    if (GetRoot(watch.path()) != kRoot) {
+      return false;
+    }
+  }
+  for (const auto& watch : request.persistent_watches()) {
+    if (GetRoot(watch.path()) != kRoot) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool SaberSession::CheckMultiRequest(const MultiRequest& request) {
+  if (request.ops_size() == 0) {
+    return false;
+  }
+  // The path of the trace is the first one.
+  path_.clear();
+  size_t size = 0;
+  for (const auto& op : request.ops()) {
+    const std::string* path = nullptr;
+    switch (op.type()) {
+      case MT_CREATE:
+        path = &op.create().path();
+        size += op.create().data().size();
+        break;
+      case MT_DELETE:
+        path = &op.remove().path();
+        break;
+      case MT_SETDATA:
+        path = &op.set_data().path();
+        size += op.set_data().data().size();
+        break;
+      case MT_CHECK:
+        path = &op.check().path();
+        break;
+      default:
+        return false;
+    }
+    if (path_.empty()) {
+      path_ = *path;
+    }
+    if (GetRoot(*path) != kRoot) {
+      return false;
+    }
+  }
+  // The whole proposal is bounded as a single write.
+  return size <= kMaxDataSize;
+}
+
+bool SaberSession::MergeChunks(SetDataRequest* request) {
+  if (!request->more() && request->upload_offset() == 0) {
+    return true;
+  }
+  if (request->upload_offset() == 0) {
+    upload_path_ = request->path();
+    upload_.clear();
+  } else if (upload_path_ != request->path() ||
+             upload_.size() != request->upload_offset()) {
+    upload_path_.clear();
+    upload_.clear();
+    return false;
+  }
+  if (upload_.size() + request->data().size() > kMaxDataSize) {
+    upload_path_.clear();
+    upload_.clear();
+    return false;
+  }
+  upload_.append(request->data());
+  if (!request->more()) {
+    request->set_data(std::move(upload_));
+    request->clear_upload_offset();
+    upload_path_.clear();
+    upload_.clear();
+  }
+  return true;
+}
+
+void SaberSession::GetSubtree(const GetSubtreeRequest& request,
+                              GetSubtreeResponse* response) {
+  uint64_t now = NowMicros();
+  uint64_t id = request.stream_id();
+  if (id == 0) {
+    SubtreeStream stream;
+    if (request.walk()) {
+      stream.walk = true;
+      stream.path = request.path();
+      stream.with_data = request.with_data();
+    } else {
+      ResponseCode code =
+          db_->GetSubtree(group_id_, request.path(), request.with_data(),
+                          kMaxSubtreeNodes, kMaxSubtreeSize, &stream.nodes);
+      if (code != RC_OK) {
+        response->set_code(code);
+        return;
+      }
+    }
+    stream.chunk_size = request.max_chunk_size();
+    if (stream.chunk_size == 0 || stream.chunk_size > kMaxDataSize) {
+      stream.chunk_size = kMaxDataSize;
+    }
+    if (streams_.size() >= kMaxSubtreeStreams) {
+      streams_.erase(streams_.begin());
+    }
+    id = ++next_stream_id_;
+    streams_[id] = std::move(stream);
+  }
+
+  auto it = streams_.find(id);
+  if (it == streams_.end()) {
+    response->set_code(RC_FAILED);
+    return;
+  }
+  SubtreeStream& stream = it->second;
+  stream.last_time = now;
+  bool done = false;
+  if (stream.walk) {
+    std::vector<SubtreeNode> nodes;
+    ResponseCode code =
+        db_->WalkSubtree(group_id_, stream.path, stream.last_path,
+                         stream.with_data, stream.chunk_size, &nodes, &done);
+    if (code != RC_OK) {
+      streams_.erase(it);
+      response->set_code(code);
+      return;
+    }
+    if (!nodes.empty()) {
+      stream.last_path = nodes.back().path();
+    }
+    for (auto& node : nodes) {
+      response->add_nodes()->Swap(&node);
+    }
+  } else {
+    size_t size = 0;
+    while (stream.next < stream.nodes.size()) {
+      SubtreeNode& node = stream.nodes[stream.next];
+      size += node.path().size() + node.data().size();
+      if (size > stream.chunk_size && response->nodes_size() > 0) {
+        break;
+      }
+      response->add_nodes()->Swap(&node);
+      ++stream.next;
+    }
+    done = (stream.next == stream.nodes.size());
+  }
+  response->set_code(RC_OK);
+  response->set_stream_id(id);
+  if (done) {
+    response->set_done(true);
+    streams_.erase(it);
+  }
+}
+
+void SaberSession::DropSubtreeStreams(uint64_t now) {
+  if (reset_streams_.exchange(false)) {
+    streams_.clear();
+  }
+  for (auto it = streams_.begin(); it != streams_.end();) {
+    if (now - it->second.last_time > kSubtreeStreamTimeout) {
+      it = streams_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 void SaberSession::SetFailedState(SaberMessage* reply_message) {
   switch (reply_message->type()) {
     case MT_CREATE: {
@@ -292,6 +685,18 @@ void SaberSession::SetFailedState(SaberMessage* reply_message) {
       reply_message->set_data(response.SerializeAsString());
       break;
     }
+    case MT_MULTI: {
+      MultiResponse response;
+      response.set_code(RC_FAILED);
+      reply_message->set_data(response.SerializeAsString());
+      break;
+    }
+    case MT_INCREMENT: {
+      IncrementResponse response;
+      response.set_code(RC_FAILED);
+      reply_message->set_data(response.SerializeAsString());
+      break;
+    }
     case MT_CLOSE: {
       CloseResponse response;
       response.set_code(RC_FAILED);
@@ -306,11 +711,64 @@ void SaberSession::SetFailedState(SaberMessage* reply_message) {
   }
 }
 
-void SaberSession::Process(const WatchedEvent& event) {
-  SaberMessage message;
-  message.set_type(MT_NOTIFICATION);
-  message.set_data(event.SerializeAsString());
-  codec_.SendMessage(conn_wp_.lock(), message);
+void SaberSession::Notify(
+    const std::string& path, EventType type,
+    const std::shared_ptr<const SaberMessage>& notification) {
+  voyager::TcpConnectionPtr p;
+  uint32_t window = 0;
+  {
+    std::lock_guard<std::mutex> lock(coalescer_->mutex);
+    p = coalescer_->conn_wp.lock();
+    if (!p) {
+      return;
+    }
+    if (coalescer_->window > 0) {
+      std::string key(1, static_cast<char>('0' + type));
+      key.append(path);
+      Coalescer::List& notifications = coalescer_->notifications;
+      auto it = coalescer_->index.find(key);
+      if (it != coalescer_->index.end()) {
+        // Move the latest one to the end, so the order between the
+        // different events of the path is still right.
+        notifications.erase(it->second);
+      }
+      notifications.push_back(notification);
+      coalescer_->index[key] = std::prev(notifications.end());
+      if (coalescer_->scheduled) {
+        return;
+      }
+      coalescer_->scheduled = true;
+      window = coalescer_->window;
+    }
+  }
+  if (window > 0) {
+    std::shared_ptr<Coalescer> coalescer = coalescer_;
+    Notifier* notifier = notifier_;
+    p->OwnerEventLoop()->RunAfter(window, [coalescer, notifier]() {
+      FlushCoalesced(coalescer, notifier);
+    });
+  } else {
+    notifier_->Notify(p, notification);
+  }
+}
+
+void SaberSession::FlushCoalesced(const std::shared_ptr<Coalescer>& coalescer,
+                                  Notifier* notifier) {
+  Coalescer::List notifications;
+  voyager::TcpConnectionPtr p;
+  {
+    std::lock_guard<std::mutex> lock(coalescer->mutex);
+    notifications.swap(coalescer->notifications);
+    coalescer->index.clear();
+    coalescer->scheduled = false;
+    p = coalescer->conn_wp.lock();
+  }
+  // They are queued in this loop, so they are sent in one batch.
+  if (p) {
+    for (auto& notification : notifications) {
+      notifier->Notify(p, notification);
+    }
+  }
 }
 
 }  // namespace saber
@@ -5,10 +5,16 @@
 #ifndef SABER_SERVER_SABER_SESSION_H_
 #define SABER_SERVER_SABER_SESSION_H_
 
+#include <atomic>
 #include <deque>
+#include <list>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <skywalker/node.h>
 
@@ -16,44 +22,129 @@
 #include <voyager/protobuf/protobuf_codec.h>
 
 #include "saber/proto/saber.pb.h"
+#include "saber/server/notifier.h"
 #include "saber/server/saber_db.h"
-#include "saber/service/watcher.h"
+#include "saber/server/server_metrics.h"
+#include "saber/server/server_watch_manager.h"
+#include "saber/server/tracer.h"
 
 namespace saber {
 
-class SaberSession : public Watcher,
+class SaberSession : public ServerWatcher,
                      public std::enable_shared_from_this<SaberSession> {
  public:
   static uint32_t kMaxDataSize;
+  // The bytes of a request besides the data, such as the paths.
+  static const uint32_t kMaxMessageOverhead = 64 * 1024;
+  // See ServerOptions::max_subtree_nodes and max_subtree_size.
+  static uint32_t kMaxSubtreeNodes;
+  static uint32_t kMaxSubtreeSize;
+  // The max requests of a MultiGetData, its data is at most kMaxDataSize.
+  static const int kMaxMultiGetDataPaths = 1024;
 
   SaberSession(const std::string& root, uint32_t group_id, uint64_t session_id,
                const voyager::TcpConnectionPtr& p, SaberDB* db,
-               skywalker::Node* node);
+               skywalker::Node* node, ServerMetrics* metrics, Tracer* tracer,
+               Notifier* notifier);
   virtual ~SaberSession();
 
+  // The max uncompressed data size of a compressed message from a client.
+  static uint32_t MaxUncompressedSize() {
+    return kMaxDataSize + kMaxMessageOverhead;
+  }
+
   uint32_t group_id() const { return group_id_; }
   uint64_t session_id() const { return session_id_; }
 
   void set_version(uint64_t version) { version_ = version; }
+
+  // See ConnectRequest.coalesce_window.
+  void set_coalesce_window(uint32_t window);
   uint64_t version() const { return version_; }
 
+  // See ConnectResponse.compress_threshold.
+  void set_compress_threshold(uint32_t threshold) {
+    compress_threshold_ = threshold;
+  }
+
+  // Compress the data of the message sent to the client if it is worth it.
+  void Compress(SaberMessage* message);
+
   voyager::TcpConnectionPtr GetTcpConnectionPtr() const {
     return conn_wp_.lock();
   }
 
   void OnConnect(const voyager::TcpConnectionPtr& p);
 
+  size_t GetPendingSize() const;
+
   bool OnMessage(std::unique_ptr<SaberMessage> message);
 
-  virtual void Process(const WatchedEvent& event);
+  virtual void Notify(const std::string& path, EventType type,
+                      const std::shared_ptr<const SaberMessage>& notification);
 
  private:
+  // A subtree read in progress, see GetSubtreeRequest.
+  struct SubtreeStream {
+    // The snapshot, and the next node to send.
+    std::vector<SubtreeNode> nodes;
+    size_t next;
+    // Or the walk without a snapshot, and the last path sent.
+    bool walk;
+    std::string path;
+    bool with_data;
+    std::string last_path;
+    uint32_t chunk_size;
+    // When the last chunk was read, in microseconds.
+    uint64_t last_time;
+
+    SubtreeStream()
+        : next(0), walk(false), with_data(false), chunk_size(0), last_time(0) {}
+  };
+
+  // The oldest stream is dropped when a new one is over it, and the ones
+  // idle for the timeout (in microseconds) or of an old connection are
+  // dropped too.
+  static const size_t kMaxSubtreeStreams = 4;
+  static const uint64_t kSubtreeStreamTimeout = 60 * 1000 * 1000;
+
+  // The notifications delayed by the coalescing window. It is shared with
+  // the timer, which may fire after the session is gone.
+  struct Coalescer {
+    typedef std::list<std::shared_ptr<const SaberMessage>> List;
+
+    Coalescer() : window(0), scheduled(false) {}
+
+    std::mutex mutex;
+    uint32_t window;
+    bool scheduled;
+    std::weak_ptr<voyager::TcpConnection> conn_wp;
+    // The latest notification of every event type and path, in the order
+    // they were notified.
+    List notifications;
+    std::unordered_map<std::string, List::iterator> index;
+  };
+
+  static void FlushCoalesced(const std::shared_ptr<Coalescer>& coalescer,
+                             Notifier* notifier);
+
   static void WeakCallback(std::weak_ptr<SaberSession> session_wp,
                            uint64_t instance_id, const skywalker::Status& s,
                            void* context);
   static void SetFailedState(SaberMessage* reply_message);
 
-  void HandleMessage(std::unique_ptr<SaberMessage> message);
+  // All the watch paths must be under the root of the session.
+  bool CheckSetWatchesRequest(const SetWatchesRequest& request);
+  bool CheckMultiRequest(const MultiRequest& request);
+  // Keep a chunk of SetData with more, or merge the kept chunks into the
+  // last one. False if a chunk is missing or the data is too big.
+  bool MergeChunks(SetDataRequest* request);
+  void GetSubtree(const GetSubtreeRequest& request,
+                  GetSubtreeResponse* response);
+  void DropSubtreeStreams(uint64_t now);
+
+  void HandleMessage(uint64_t receive_time,
+                     std::unique_ptr<SaberMessage> message);
   void DoIt(std::unique_ptr<SaberMessage> message);
   void Done(std::unique_ptr<SaberMessage> message);
   void Propose(std::unique_ptr<SaberMessage> message);
@@ -64,6 +155,7 @@ class SaberSession : public Watcher,
   const uint64_t session_id_;
 
   uint64_t version_;
+  std::atomic<uint32_t> compress_threshold_;
   bool closed_;
   bool last_finished_;
 
@@ -71,9 +163,29 @@ class SaberSession : public Watcher,
   std::weak_ptr<voyager::TcpConnection> conn_wp_;
   SaberDB* db_;
   skywalker::Node* node_;
-
-  std::mutex mutex_;
-  std::deque<std::unique_ptr<SaberMessage>> pending_messages_;
+  ServerMetrics* metrics_;
+  Tracer* tracer_;
+  Notifier* notifier_;
+  std::shared_ptr<Coalescer> coalescer_;
+
+  // Only one message is handled at a time, so they are the propose time,
+  // the trace and the request path of the current message.
+  uint64_t propose_time_;
+  Trace trace_;
+  std::string path_;
+
+  // Only used by DoIt, so they need no lock either.
+  uint64_t next_stream_id_;
+  std::map<uint64_t, SubtreeStream> streams_;
+  // Set by OnConnect, the streams of the old connection are dropped.
+  std::atomic<bool> reset_streams_;
+  std::string upload_path_;
+  std::string upload_;
+
+  mutable std::mutex mutex_;
+  // The first value is the time (in microseconds) when it was received.
+  std::deque<std::pair<uint64_t, std::unique_ptr<SaberMessage>>>
+      pending_messages_;
 
   // No copying allowed
   SaberSession(const SaberSession&);
@@ -0,0 +1,99 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/server/server_metrics.h"
+
+#include <assert.h>
+
+namespace saber {
+
+static std::atomic<uint32_t> next_shard_index(0);
+static thread_local uint32_t shard_index = next_shard_index++;
+
+const char* ServerMetrics::PhaseName(Phase phase) {
+  static const char* kPhaseNames[] = {"queue", "check", "propose", "execute",
+                                      "reply"};
+  return kPhaseNames[phase];
+}
+
+const char* ServerMetrics::CounterName(Counter counter) {
+  static const char* kCounterNames[] = {
+      "received",  "redirected", "propose_failed", "compressed",
+      "raw_bytes", "wire_bytes", "codec_micros"};
+  return kCounterNames[counter];
+}
+
+ServerMetrics::Shard::Shard(uint32_t group_size)
+    : by_type(new Histogram[kPhaseSize * kTypeSize]),
+      by_group(new Histogram[kPhaseSize * group_size]) {
+  for (int i = 0; i < kCounterSize; ++i) {
+    for (int j = 0; j < kTypeSize; ++j) {
+      counters[i][j] = 0;
+    }
+  }
+}
+
+ServerMetrics::ServerMetrics(uint32_t group_size) : group_size_(group_size) {
+  for (int i = 0; i < kShardSize; ++i) {
+    shards_.push_back(std::unique_ptr<Shard>(new Shard(group_size_)));
+  }
+}
+
+ServerMetrics::~ServerMetrics() {}
+
+ServerMetrics::Shard* ServerMetrics::MyShard() {
+  return shards_[shard_index % kShardSize].get();
+}
+
+void ServerMetrics::Record(Phase phase, MessageType type, uint32_t group_id,
+                           uint64_t micros) {
+  assert(group_id < group_size_);
+  if (!MessageType_IsValid(type)) {
+    return;
+  }
+  Shard* shard = MyShard();
+  shard->by_type[phase * kTypeSize + type].Add(micros);
+  shard->by_group[phase * group_size_ + group_id].Add(micros);
+}
+
+void ServerMetrics::Increment(Counter counter, MessageType type) {
+  Add(counter, type, 1);
+}
+
+void ServerMetrics::Add(Counter counter, MessageType type, uint64_t n) {
+  if (!MessageType_IsValid(type)) {
+    return;
+  }
+  MyShard()->counters[counter][type].fetch_add(n, std::memory_order_relaxed);
+}
+
+void ServerMetrics::GetByType(Phase phase, MessageType type,
+                              Histogram* result) const {
+  if (!MessageType_IsValid(type)) {
+    return;
+  }
+  for (auto& shard : shards_) {
+    result->Merge(shard->by_type[phase * kTypeSize + type]);
+  }
+}
+
+void ServerMetrics::GetByGroup(Phase phase, uint32_t group_id,
+                               Histogram* result) const {
+  for (auto& shard : shards_) {
+    result->Merge(shard->by_group[phase * group_size_ + group_id]);
+  }
+}
+
+uint64_t ServerMetrics::GetCounter(Counter counter, MessageType type) const {
+  uint64_t n = 0;
+  if (!MessageType_IsValid(type)) {
+    return n;
+  }
+  for (auto& shard : shards_) {
+    n += shard->counters[counter][type].load(std::memory_order_relaxed);
+  }
+  return n;
+}
+
+}  // namespace saber
@@ -0,0 +1,96 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_SERVER_SERVER_METRICS_H_
+#define SABER_SERVER_SERVER_METRICS_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "saber/proto/saber.pb.h"
+#include "saber/util/histogram.h"
+
+namespace saber {
+
+// The latency (in microseconds) histograms and the counters of every request
+// phase, kept both by message type and by paxos group. The records go to
+// the shard of the calling thread and the shards are merged on read, so
+// the request path never contends on them.
+class ServerMetrics {
+ public:
+  enum Phase {
+    // From the message received to SaberSession::DoIt.
+    kQueue = 0,
+    // The reads or the Check* validation in SaberSession::DoIt.
+    kCheck = 1,
+    // From node_->Propose to SaberSession::WeakCallback.
+    kPropose = 2,
+    // SaberDB::Execute.
+    kExecute = 3,
+    // Send the reply.
+    kReply = 4,
+    kPhaseSize = 5
+  };
+
+  enum Counter {
+    kReceived = 0,
+    // Told the client to go to the master.
+    kRedirected = 1,
+    kProposeFailed = 2,
+    // The messages compressed or uncompressed on the wire, their data size
+    // before and after the compression, and the time (in microseconds)
+    // spent by both, including the tries not worth it.
+    kCompressed = 3,
+    kRawBytes = 4,
+    kWireBytes = 5,
+    kCodecMicros = 6,
+    kCounterSize = 7
+  };
+
+  static const char* PhaseName(Phase phase);
+  static const char* CounterName(Counter counter);
+
+  explicit ServerMetrics(uint32_t group_size);
+  ~ServerMetrics();
+
+  uint32_t group_size() const { return group_size_; }
+
+  // The unknown message types (the enum of proto3 is open) are ignored.
+  void Record(Phase phase, MessageType type, uint32_t group_id,
+              uint64_t micros);
+  void Increment(Counter counter, MessageType type);
+  void Add(Counter counter, MessageType type, uint64_t n);
+
+  // Merge all shards into *result.
+  void GetByType(Phase phase, MessageType type, Histogram* result) const;
+  void GetByGroup(Phase phase, uint32_t group_id, Histogram* result) const;
+  uint64_t GetCounter(Counter counter, MessageType type) const;
+
+ private:
+  static const int kShardSize = 8;
+  static const int kTypeSize = MessageType_ARRAYSIZE;
+
+  struct Shard {
+    explicit Shard(uint32_t group_size);
+    std::unique_ptr<Histogram[]> by_type;
+    std::unique_ptr<Histogram[]> by_group;
+    std::atomic<uint64_t> counters[kCounterSize][kTypeSize];
+  };
+
+  Shard* MyShard();
+
+  const uint32_t group_size_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  // No copying allowed
+  ServerMetrics(const ServerMetrics&);
+  void operator=(const ServerMetrics&);
+};
+
+}  // namespace saber
+
+#endif  // SABER_SERVER_SERVER_METRICS_H_
@@ -19,9 +19,19 @@ ServerOptions::ServerOptions()
       max_all_connections(60000),
       max_ip_connections(60),
       max_data_size(1024 * 1024),
+      max_subtree_nodes(100000),
+      max_subtree_size(64 * 1024 * 1024),
+      max_watch_data_size(4096),
+      compress_threshold(0),
+      wire_compress_threshold(1024),
       keep_log_count(1000000),
       log_sync_interval(10),
       keep_checkpoint_count(3),
+      trace_sample_rate(0),
+      trace_buffer_size(1024),
+      enable_stats(false),
+      slow_request_time(100),
+      slow_request_logs_per_second(10),
       cluster(nullptr) {}
 
 }  // namespace saber
@@ -73,6 +73,30 @@ struct ServerOptions {
   // Default: 1024 * 1024
   uint32_t max_data_size;
 
+  // The max nodes, and the max bytes of their paths and data, of a subtree
+  // snapshot of GetSubtree. The snapshot is copied under the lock of the
+  // tree, which holds the writes back for the copy, so a bigger subtree
+  // (such as the export of a large root) fails with RC_TOO_LARGE and must
+  // be read with GetSubtreeRequest.walk instead.
+  // Default: 100000, 64 * 1024 * 1024
+  uint32_t max_subtree_nodes;
+  uint32_t max_subtree_size;
+
+  // The max data size carried by the events of the watches with_data.
+  // Default: 4096
+  uint32_t max_watch_data_size;
+
+  // Keep the data of a node compressed in memory and in the checkpoints
+  // if it is at least the size and gets smaller, zero means never.
+  // Default: 0
+  uint32_t compress_threshold;
+
+  // The min data size of the messages compressed on the wire for the
+  // clients asking for it (see ConnectRequest.compress_threshold), the
+  // larger one of the two is used. Zero means never.
+  // Default: 1024
+  uint32_t wire_compress_threshold;
+
   // Default: 1000000
   uint32_t keep_log_count;
 
@@ -85,6 +109,29 @@ struct ServerOptions {
   // Default: 3
   uint32_t keep_checkpoint_count;
 
+  // The rate of the messages to be traced between [0, 1], the messages
+  // traced by the clients are always recorded.
+  // Default: 0
+  double trace_sample_rate;
+
+  // The number of the recent traces to keep.
+  // Default: 1024
+  uint32_t trace_buffer_size;
+
+  // Answer MT_STATS (see SaberServer::GetStats), which needs no session and
+  // reports every root and the recent traces of them all, so only enable it
+  // when the client port is reachable by trusted peers only.
+  // Default: false
+  bool enable_stats;
+
+  // The requests slower than it are logged with the time of every phase,
+  // 0 means disabled.
+  // Default: 100ms
+  uint32_t slow_request_time;
+
+  // Default: 10
+  uint32_t slow_request_logs_per_second;
+
   ServerMessage my_server_message;
   std::vector<ServerMessage> all_server_messages;
 
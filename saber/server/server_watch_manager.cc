@@ -4,51 +4,305 @@
 
 #include "saber/server/server_watch_manager.h"
 
+#include <assert.h>
+
+#include <functional>
+
 namespace saber {
 
-ServerWatchManager::ServerWatchManager() {}
+void ServerWatcher::Process(const WatchedEvent& event) {
+  auto message = std::make_shared<SaberMessage>();
+  message->set_type(MT_NOTIFICATION);
+  message->set_data(event.SerializeAsString());
+  Notify(event.path(), event.type(), message);
+}
+
+const char* ServerWatchManager::WatchTypeName(WatchType type) {
+  static const char* kWatchTypeNames[] = {"data", "child", "persistent",
+                                          "recursive"};
+  return kWatchTypeNames[type];
+}
+
+uint32_t ServerWatchManager::kMaxWatchDataSize = 4096;
+
+void ServerWatchManager::Merge(const WatcherMap& from, WatcherMap* to) {
+  for (auto& it : from) {
+    (*to)[it.first] |= it.second;
+  }
+}
+
+ServerWatchManager::ServerWatchManager() : root_(nullptr, "") {
+  trie_paths_[0] = 0;
+  trie_paths_[1] = 0;
+}
 
 ServerWatchManager::~ServerWatchManager() {}
 
-void ServerWatchManager::AddWatcher(const std::string& path, Watcher* watcher) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  path_to_watches_[path].insert(watcher);
-  watch_to_paths_[watcher].insert(path);
+ServerWatchManager::Shard* ServerWatchManager::GetShard(
+    const std::string& path) {
+  return &shards_[std::hash<std::string>()(path) % kShardSize];
+}
+
+ServerWatchManager::TrieNode* ServerWatchManager::FindNode(
+    const std::string& path, bool create) {
+  TrieNode* node = &root_;
+  size_t i = 1;
+  while (i < path.size()) {
+    size_t j = path.find('/', i);
+    if (j == std::string::npos) {
+      j = path.size();
+    }
+    std::string name = path.substr(i, j - i);
+    auto it = node->children.find(name);
+    if (it == node->children.end()) {
+      if (!create) {
+        return nullptr;
+      }
+      TrieNode* child = new TrieNode(node, name);
+      node->children[name].reset(child);
+      node = child;
+    } else {
+      node = it->second.get();
+    }
+    i = j + 1;
+  }
+  return node;
+}
+
+void ServerWatchManager::TryRemoveNode(TrieNode* node) {
+  while (node != &root_ && node->children.empty() &&
+         node->watchers[0].empty() && node->watchers[1].empty()) {
+    TrieNode* parent = node->parent;
+    parent->children.erase(node->name);
+    node = parent;
+  }
+}
+
+void ServerWatchManager::AddWatcher(const std::string& path,
+                                    ServerWatcher* watcher, WatchType type,
+                                    bool with_data) {
+  if (type == kData || type == kChild) {
+    Shard* shard = GetShard(path);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    auto it = shard->path_to_watches[type].find(path);
+    if (it == shard->path_to_watches[type].end()) {
+      it = shard->path_to_watches[type].emplace(path, WatcherMap()).first;
+    }
+    it->second[watcher] |= with_data;
+    shard->watch_to_paths[type][watcher].insert(&it->first);
+  } else {
+    int i = type - kPersistent;
+    std::lock_guard<std::mutex> lock(trie_mutex_);
+    auto& watchers = FindNode(path, true)->watchers[i];
+    if (watchers.empty()) {
+      ++trie_paths_[i];
+    }
+    watchers[watcher] |= with_data;
+    trie_watches_[i][watcher].insert(path);
+  }
+}
+
+bool ServerWatchManager::RemoveTrieWatcherLocked(const std::string& path,
+                                                 ServerWatcher* watcher,
+                                                 int index) {
+  TrieNode* node = FindNode(path, false);
+  if (!node || !node->watchers[index].erase(watcher)) {
+    return false;
+  }
+  if (node->watchers[index].empty()) {
+    --trie_paths_[index];
+  }
+  TryRemoveNode(node);
+  return true;
+}
+
+bool ServerWatchManager::RemoveWatcher(const std::string& path,
+                                       ServerWatcher* watcher,
+                                       WatchType type) {
+  if (type == kData || type == kChild) {
+    Shard* shard = GetShard(path);
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    auto it = shard->path_to_watches[type].find(path);
+    if (it == shard->path_to_watches[type].end() ||
+        !it->second.erase(watcher)) {
+      return false;
+    }
+    auto j = shard->watch_to_paths[type].find(watcher);
+    assert(j != shard->watch_to_paths[type].end());
+    j->second.erase(&it->first);
+    if (j->second.empty()) {
+      shard->watch_to_paths[type].erase(j);
+    }
+    if (it->second.empty()) {
+      shard->path_to_watches[type].erase(it);
+    }
+  } else {
+    int i = type - kPersistent;
+    std::lock_guard<std::mutex> lock(trie_mutex_);
+    if (!RemoveTrieWatcherLocked(path, watcher, i)) {
+      return false;
+    }
+    auto j = trie_watches_[i].find(watcher);
+    assert(j != trie_watches_[i].end());
+    j->second.erase(path);
+    if (j->second.empty()) {
+      trie_watches_[i].erase(j);
+    }
+  }
+  return true;
 }
 
-void ServerWatchManager::RemoveWatcher(Watcher* watcher) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto i = watch_to_paths_.find(watcher);
-  if (i != watch_to_paths_.end()) {
-    for (const auto& path : i->second) {
-      auto j = path_to_watches_.find(path);
-      j->second.erase(watcher);
-      if (j->second.empty()) {
-        path_to_watches_.erase(j);
+void ServerWatchManager::RemoveWatcher(ServerWatcher* watcher) {
+  {
+    std::lock_guard<std::mutex> lock(trie_mutex_);
+    for (int i = 0; i < 2; ++i) {
+      auto it = trie_watches_[i].find(watcher);
+      if (it != trie_watches_[i].end()) {
+        for (const auto& path : it->second) {
+          RemoveTrieWatcherLocked(path, watcher, i);
+        }
+        trie_watches_[i].erase(it);
+      }
+    }
+  }
+  for (auto& shard : shards_) {
+    std::unique_lock<std::mutex> lock(shard.mutex);
+    for (int type = 0; type < 2; ++type) {
+      auto it = shard.watch_to_paths[type].find(watcher);
+      if (it == shard.watch_to_paths[type].end()) {
+        continue;
+      }
+      for (const std::string* path : it->second) {
+        auto j = shard.path_to_watches[type].find(*path);
+        j->second.erase(watcher);
+        if (j->second.empty()) {
+          shard.path_to_watches[type].erase(j);
+        }
       }
+      shard.watch_to_paths[type].erase(it);
     }
-    watch_to_paths_.erase(i);
+    shard.cond.wait(lock, [&shard]() { return shard.triggering == 0; });
   }
 }
 
-void ServerWatchManager::TriggerWatcher(const std::string& path, EventType type) {
-  std::lock_guard<std::mutex> lock(mutex_);
-  auto i = path_to_watches_.find(path);
-  if (i != path_to_watches_.end()) {
-    WatchedEvent event;
-    event.set_state(SS_CONNECTED);
-    event.set_type(type);
-    event.set_path(path);
+void ServerWatchManager::TakeOneShotLocked(Shard* shard,
+                                           const std::string& path,
+                                           WatchType type,
+                                           WatcherMap* watchers) {
+  auto i = shard->path_to_watches[type].find(path);
+  if (i == shard->path_to_watches[type].end()) {
+    return;
+  }
+  for (auto& it : i->second) {
+    auto j = shard->watch_to_paths[type].find(it.first);
+    j->second.erase(&i->first);
+    if (j->second.empty()) {
+      shard->watch_to_paths[type].erase(j);
+    }
+  }
+  Merge(i->second, watchers);
+  shard->path_to_watches[type].erase(i);
+}
 
-    for (auto watcher : i->second) {
-      auto j = watch_to_paths_.find(watcher);
-      j->second.erase(path);
-      if (j->second.empty()) {
-        watch_to_paths_.erase(j);
+void ServerWatchManager::TriggerWatcher(const std::string& path,
+                                        EventType type, const Stat* stat,
+                                        const std::string* data) {
+  WatcherMap watchers;
+  Shard* shard = GetShard(path);
+  {
+    std::lock_guard<std::mutex> lock(shard->mutex);
+    // The one-shot watches, a deleted node fires its child watches too.
+    if (type == ET_NODE_CHILDREN_CHANGED) {
+      TakeOneShotLocked(shard, path, kChild, &watchers);
+    } else {
+      TakeOneShotLocked(shard, path, kData, &watchers);
+      if (type == ET_NODE_DELETED) {
+        TakeOneShotLocked(shard, path, kChild, &watchers);
       }
-      watcher->Process(event);
     }
-    path_to_watches_.erase(i);
+
+    // The persistent watches of the path, and the recursive watches of the
+    // path and its ancestors.
+    if (trie_paths_[0] > 0 || trie_paths_[1] > 0) {
+      std::lock_guard<std::mutex> trie_lock(trie_mutex_);
+      bool recursive = (type != ET_NODE_CHILDREN_CHANGED);
+      TrieNode* node = &root_;
+      size_t k = 1;
+      while (node) {
+        if (recursive) {
+          Merge(node->watchers[1], &watchers);
+        }
+        if (k >= path.size()) {
+          Merge(node->watchers[0], &watchers);
+          break;
+        }
+        size_t j = path.find('/', k);
+        if (j == std::string::npos) {
+          j = path.size();
+        }
+        auto it = node->children.find(path.substr(k, j - k));
+        node = (it == node->children.end()) ? nullptr : it->second.get();
+        k = j + 1;
+      }
+    }
+
+    if (watchers.empty()) {
+      return;
+    }
+    ++shard->triggering;
+  }
+
+  // At most two notifications are built for an event, one is shared by
+  // the watches with_data and the other is shared by the others.
+  std::shared_ptr<const SaberMessage> notifications[2];
+  WatchedEvent event;
+  event.set_state(SS_CONNECTED);
+  event.set_type(type);
+  event.set_path(path);
+  for (auto& it : watchers) {
+    int i = (it.second && stat) ? 1 : 0;
+    if (!notifications[i]) {
+      auto message = std::make_shared<SaberMessage>();
+      message->set_type(MT_NOTIFICATION);
+      if (i == 1) {
+        WatchedEvent rich(event);
+        *(rich.mutable_stat()) = *stat;
+        if (data && data->size() <= kMaxWatchDataSize) {
+          rich.set_data(*data);
+          rich.set_has_data(true);
+        }
+        message->set_data(rich.SerializeAsString());
+      } else {
+        message->set_data(event.SerializeAsString());
+      }
+      notifications[i] = std::move(message);
+    }
+    it.first->Notify(path, type, notifications[i]);
+  }
+
+  std::lock_guard<std::mutex> lock(shard->mutex);
+  if (--shard->triggering == 0) {
+    shard->cond.notify_all();
+  }
+}
+
+void ServerWatchManager::GetStats(WatchType type, WatchStats* stats) {
+  stats->path_count = 0;
+  stats->watch_count = 0;
+  if (type == kData || type == kChild) {
+    for (auto& shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      stats->path_count += shard.path_to_watches[type].size();
+      for (auto& it : shard.watch_to_paths[type]) {
+        stats->watch_count += it.second.size();
+      }
+    }
+  } else {
+    std::lock_guard<std::mutex> lock(trie_mutex_);
+    stats->path_count = trie_paths_[type - kPersistent];
+    for (auto& it : trie_watches_[type - kPersistent]) {
+      stats->watch_count += it.second.size();
+    }
   }
 }
 
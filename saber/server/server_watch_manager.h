@@ -5,29 +5,149 @@
 #ifndef SABER_SERVER_SERVER_WATCH_MANAGER_H_
 #define SABER_SERVER_SERVER_WATCH_MANAGER_H_
 
+#include <atomic>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "saber/proto/saber.pb.h"
 #include "saber/service/watcher.h"
 
 namespace saber {
 
+struct WatchStats {
+  uint64_t path_count;
+  uint64_t watch_count;
+
+  WatchStats() : path_count(0), watch_count(0) {}
+};
+
+// The watchers of the server. The notification is serialized once by
+// ServerWatchManager and shared by all the watchers of the event.
+class ServerWatcher : public Watcher {
+ public:
+  ServerWatcher() {}
+  virtual ~ServerWatcher() {}
+
+  virtual void Process(const WatchedEvent& event);
+
+  // It may be called out of the lock of ServerWatchManager, so it should
+  // be cheap and not block, such as queue the notification to the owner
+  // event loop of the connection. The path and type are the ones of the
+  // serialized event.
+  virtual void Notify(
+      const std::string& path, EventType type,
+      const std::shared_ptr<const SaberMessage>& notification) = 0;
+};
+
 class ServerWatchManager {
  public:
+  enum WatchType {
+    // One-shot, triggered by the created, deleted and data changed events
+    // of the path.
+    kData = 0,
+    // One-shot, triggered by the children changed and deleted events of
+    // the path.
+    kChild = 1,
+    // Triggered by all the events of the path, and stay registered.
+    kPersistent = 2,
+    // Triggered by the created, deleted and data changed events of the path
+    // and all its descendants, and stay registered.
+    kRecursive = 3,
+    kWatchTypeSize = 4
+  };
+
+  static const char* WatchTypeName(WatchType type);
+
+  // The max data size carried by the events of the watches with_data.
+  static uint32_t kMaxWatchDataSize;
+
   ServerWatchManager();
   ~ServerWatchManager();
 
-  void AddWatcher(const std::string& path, Watcher* watcher);
-  void RemoveWatcher(Watcher* watcher);
+  // If with_data, the events of the watch carry the Stat and data of the
+  // node.
+  void AddWatcher(const std::string& path, ServerWatcher* watcher,
+                  WatchType type, bool with_data = false);
+
+  // Return false if the watcher isn't found.
+  bool RemoveWatcher(const std::string& path, ServerWatcher* watcher,
+                     WatchType type);
 
-  void TriggerWatcher(const std::string& path, EventType type);
+  // It waits until the watcher isn't notified by TriggerWatcher, so the
+  // watcher can be deleted after it returns.
+  void RemoveWatcher(ServerWatcher* watcher);
+
+  // Every watcher is notified at most once for an event. The stat and data
+  // are the new ones of the node, or nullptr if the node is deleted.
+  void TriggerWatcher(const std::string& path, EventType type,
+                      const Stat* stat = nullptr,
+                      const std::string* data = nullptr);
+
+  void GetStats(WatchType type, WatchStats* stats);
 
  private:
-  std::mutex mutex_;
-  std::unordered_map<std::string, std::unordered_set<Watcher*>> path_to_watches_;
-  std::unordered_map<Watcher*, std::unordered_set<std::string>> watch_to_paths_;
+  static const int kShardSize = 16;
+
+  // The value is true if the watch is with_data.
+  typedef std::unordered_map<ServerWatcher*, bool> WatcherMap;
+
+  // The one-shot watches are sharded by the path, so the watched reads of
+  // different paths don't contend on one lock. The paths of a watcher
+  // point to the keys of path_to_watches, which stay until no watcher
+  // refers to them.
+  struct Shard {
+    Shard() : triggering(0) {}
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    // The number of the TriggerWatcher which are notifying out of the lock.
+    int triggering;
+    // Indexed by kData and kChild.
+    std::unordered_map<std::string, WatcherMap> path_to_watches[2];
+    std::unordered_map<ServerWatcher*, std::unordered_set<const std::string*>>
+        watch_to_paths[2];
+  };
+
+  // The persistent and recursive watches are kept in a trie of the path
+  // components, so an event finds all the interested watchers in O(depth).
+  struct TrieNode {
+    TrieNode* parent;
+    std::string name;
+    std::unordered_map<std::string, std::unique_ptr<TrieNode>> children;
+    // Indexed by kPersistent - kPersistent and kRecursive - kPersistent.
+    WatcherMap watchers[2];
+
+    TrieNode(TrieNode* p, const std::string& n) : parent(p), name(n) {}
+  };
+
+  Shard* GetShard(const std::string& path);
+  // Move the one-shot watches of the path into *watchers.
+  // REQUIRES: shard->mutex held.
+  void TakeOneShotLocked(Shard* shard, const std::string& path, WatchType type,
+                         WatcherMap* watchers);
+
+  // REQUIRES: trie_mutex_ held.
+  TrieNode* FindNode(const std::string& path, bool create);
+  void TryRemoveNode(TrieNode* node);
+  bool RemoveTrieWatcherLocked(const std::string& path, ServerWatcher* watcher,
+                               int index);
+
+  static void Merge(const WatcherMap& from, WatcherMap* to);
+
+  Shard shards_[kShardSize];
+
+  // Taken after the lock of a shard by TriggerWatcher, and the triggering
+  // of that shard covers the watchers found in the trie too.
+  std::mutex trie_mutex_;
+  TrieNode root_;
+  // Read without the lock to skip the trie when it is empty.
+  std::atomic<uint64_t> trie_paths_[2];
+  std::unordered_map<ServerWatcher*, std::unordered_set<std::string>>
+      trie_watches_[2];
 
   // No copying allowed
   ServerWatchManager(const ServerWatchManager&);
@@ -77,4 +77,9 @@ std::unordered_map<uint64_t, uint64_t> SessionManager::CopySessions() const {
   return std::unordered_map<uint64_t, uint64_t>(sessions_);
 }
 
+size_t SessionManager::GetSize() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return sessions_.size();
+}
+
 }  // namespace saber
@@ -30,6 +30,8 @@ class SessionManager {
 
   std::unordered_map<uint64_t, uint64_t> CopySessions() const;
 
+  size_t GetSize() const;
+
  private:
   mutable std::mutex mutex_;
   std::unordered_map<uint64_t, uint64_t> sessions_;
@@ -0,0 +1,501 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "saber/server/data_tree.h"
+
+using namespace saber;
+
+static const uint32_t kMaxDataSize = 1024 * 1024;
+
+static int failures = 0;
+
+static void Check(bool ok, const char* what) {
+  if (!ok) {
+    printf("FAILED: %s\n", what);
+    ++failures;
+  }
+}
+
+// Record the events of its watches in order.
+class EventRecorder : public ServerWatcher {
+ public:
+  virtual void Notify(const std::string& path, EventType type,
+                      const std::shared_ptr<const SaberMessage>&) {
+    events.push_back(std::make_pair(path, type));
+  }
+
+  size_t Count(const std::string& path, EventType type) const {
+    size_t n = 0;
+    for (auto& e : events) {
+      if (e.first == path && e.second == type) {
+        ++n;
+      }
+    }
+    return n;
+  }
+
+  // The position of the first event, or events.size() if none.
+  size_t Find(const std::string& path, EventType type) const {
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (events[i].first == path && events[i].second == type) {
+        return i;
+      }
+    }
+    return events.size();
+  }
+
+  std::vector<std::pair<std::string, EventType>> events;
+};
+
+static Transaction MakeTxn(uint64_t instance_id) {
+  Transaction txn;
+  txn.set_session_id(1);
+  txn.set_instance_id(instance_id);
+  txn.set_time(instance_id);
+  return txn;
+}
+
+static ResponseCode Create(DataTree* tree, const std::string& path,
+                           const std::string& data,
+                           NodeType type = NT_PERSISTENT) {
+  static uint64_t instance_id = 1000;
+  Transaction txn = MakeTxn(++instance_id);
+  CreateRequest request;
+  CreateResponse response;
+  request.set_path(path);
+  request.set_data(data);
+  request.set_node_type(type);
+  tree->Create(request, &txn, &response);
+  return response.code();
+}
+
+static ResponseCode GetData(DataTree* tree, const std::string& path,
+                            std::string* data, Stat* stat = nullptr) {
+  GetDataRequest request;
+  GetDataResponse response;
+  request.set_path(path);
+  tree->GetData(request, nullptr, &response);
+  *data = response.data();
+  if (stat) {
+    *stat = response.stat();
+  }
+  return response.code();
+}
+
+static size_t ChildrenSize(DataTree* tree, const std::string& path) {
+  GetChildrenRequest request;
+  GetChildrenResponse response;
+  request.set_path(path);
+  tree->GetChildren(request, nullptr, &response);
+  return static_cast<size_t>(response.children_size());
+}
+
+static void TestMultiRollback() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/p", "");
+  // The children of a sequential node get a suffix.
+  Create(&tree, "/m", "", NT_PERSISTENT_SEQUENTIAL);
+  Create(&tree, "/m/x", "base");
+  const std::string base = "/m/x_0000000001";
+  std::string data;
+  Stat before;
+  GetData(&tree, "/m", &data, &before);
+
+  MultiRequest request;
+  MultiOp* op = request.add_ops();
+  op->set_type(MT_CREATE);
+  op->mutable_create()->set_path("/p/a");
+  op = request.add_ops();
+  op->set_type(MT_CREATE);
+  op->mutable_create()->set_path(base);
+  op = request.add_ops();
+  op->set_type(MT_SETDATA);
+  op->mutable_set_data()->set_path(base);
+  op->mutable_set_data()->set_version(-1);
+  op->mutable_set_data()->set_data("changed");
+  op = request.add_ops();
+  op->set_type(MT_DELETE);
+  op->mutable_remove()->set_path("/p/missing");
+
+  // The dry run of the check, and then the real one.
+  for (int only_check = 1; only_check >= 0; --only_check) {
+    Transaction txn = MakeTxn(2000);
+    MultiResponse response;
+    tree.Multi(request, &txn, &response, only_check == 1);
+    Check(response.code() == RC_NO_NODE, "multi fails with the last op");
+    Check(response.results(2).code() == RC_OK, "the set data is applied");
+    Check(GetData(&tree, "/p/a", &data) == RC_NO_NODE,
+          "the created node is rolled back");
+    Check(GetData(&tree, base + "_0000000002", &data) == RC_NO_NODE,
+          "the sequential node is rolled back");
+    Check(GetData(&tree, base, &data) == RC_OK && data == "base",
+          "the node of the unsuffixed path is kept as is");
+    Check(ChildrenSize(&tree, "/m") == 1 && ChildrenSize(&tree, "/p") == 0,
+          "no child is left over");
+    Stat after;
+    GetData(&tree, "/m", &data, &after);
+    Check(after.children_version() == before.children_version() &&
+              after.children_num() == before.children_num() &&
+              after.children_id() == before.children_id(),
+          "the parent stat is restored");
+  }
+}
+
+static void TestMultiCheckEphemeral() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/q", "", NT_PERSISTENT_SEQUENTIAL);
+  Create(&tree, "/q/own", "", NT_EPHEMERAL);
+  std::vector<std::string> before;
+  tree.GetEphemerals(1, &before);
+
+  MultiRequest request;
+  MultiOp* op = request.add_ops();
+  op->set_type(MT_CREATE);
+  op->mutable_create()->set_path("/q/e");
+  op->mutable_create()->set_node_type(NT_EPHEMERAL_SEQUENTIAL);
+  for (int i = 0; i < 3; ++i) {
+    MultiResponse response;
+    tree.Multi(request, nullptr, &response, true);
+    Check(response.code() == RC_OK, "the check of multi passes");
+  }
+  std::vector<std::string> after;
+  tree.GetEphemerals(1, &after);
+  std::vector<std::string> none;
+  tree.GetEphemerals(0, &none);
+  Check(after == before && none.empty(),
+        "the check of multi leaves the ephemerals as is");
+
+  // A later node of the same path is not taken as an ephemeral.
+  Create(&tree, "/q/e", "");
+  Transaction txn = MakeTxn(3000);
+  tree.KillSession(0, &txn);
+  std::string data;
+  Check(GetData(&tree, "/q/e_0000000002", &data) == RC_OK,
+        "the persistent node is kept");
+}
+
+static void TestSubtreeLimits() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/t", "");
+  Create(&tree, "/t/a", std::string(100, 'a'));
+  Create(&tree, "/t/b", std::string(100, 'b'));
+  std::vector<SubtreeNode> nodes;
+  Check(tree.GetSubtree("/t", true, 3, 1000, &nodes) == RC_OK &&
+            nodes.size() == 3 && nodes[1].path() == "/t/a",
+        "the subtree is read in pre-order");
+  nodes.clear();
+  Check(tree.GetSubtree("/t", true, 2, 1000, &nodes) == RC_TOO_LARGE &&
+            nodes.empty(),
+        "the subtree is over the max nodes");
+  Check(tree.GetSubtree("/t", true, 3, 200, &nodes) == RC_TOO_LARGE &&
+            nodes.empty(),
+        "the subtree is over the max size");
+  Check(tree.GetSubtree("/t", false, 3, 200, &nodes) == RC_OK,
+        "the data isn't counted without with_data");
+}
+
+static void TestWalkSubtree() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/w", "");
+  Create(&tree, "/w/a", "");
+  Create(&tree, "/w/a/x", "");
+  Create(&tree, "/w/a/y", "");
+  Create(&tree, "/w/b", "");
+  Create(&tree, "/w/b/z", "");
+  Create(&tree, "/wx", "");
+  std::vector<SubtreeNode> snapshot;
+  tree.GetSubtree("/w", false, 100, 1000, &snapshot);
+
+  // One node a chunk.
+  std::vector<std::string> walked;
+  std::string last;
+  bool done = false;
+  while (!done) {
+    std::vector<SubtreeNode> nodes;
+    if (tree.WalkSubtree("/w", last, false, 1, &nodes, &done) != RC_OK ||
+        nodes.size() > 1 || (nodes.empty() && !done)) {
+      break;
+    }
+    for (auto& node : nodes) {
+      walked.push_back(node.path());
+    }
+    if (!nodes.empty()) {
+      last = nodes.back().path();
+    }
+  }
+  bool same = done && walked.size() == snapshot.size();
+  for (size_t i = 0; same && i < walked.size(); ++i) {
+    same = (walked[i] == snapshot[i].path());
+  }
+  Check(same, "the walk reads the nodes of the snapshot in order");
+
+  // Resumed after a path which is gone.
+  DeleteRequest request;
+  DeleteResponse response;
+  Transaction txn = MakeTxn(6000);
+  request.set_path("/w/a");
+  request.set_version(-1);
+  request.set_recursive(true);
+  tree.Delete(request, &txn, &response);
+  std::vector<SubtreeNode> nodes;
+  ResponseCode code =
+      tree.WalkSubtree("/w", "/w/a/x", false, 1000, &nodes, &done);
+  Check(code == RC_OK && done && nodes.size() == 2 &&
+            nodes[0].path() == "/w/b" && nodes[1].path() == "/w/b/z",
+        "the walk resumes after a deleted path");
+  nodes.clear();
+  Check(tree.WalkSubtree("/w/missing", "", false, 1000, &nodes, &done) ==
+            RC_NO_NODE,
+        "the walk of a missing node fails");
+}
+
+static void TestRecursiveDelete() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/r", "");
+  Create(&tree, "/r/a", "");
+  Create(&tree, "/r/a/b", "");
+  Create(&tree, "/r/a/b/c", "");
+  Create(&tree, "/r/a/d", "");
+
+  EventRecorder recorder;
+  const char* paths[] = {"/r", "/r/a", "/r/a/b", "/r/a/b/c", "/r/a/d"};
+  for (const char* path : paths) {
+    AddWatchRequest request;
+    AddWatchResponse response;
+    request.set_path(path);
+    request.set_mode(WM_PERSISTENT);
+    tree.AddWatch(request, &recorder, &response);
+  }
+
+  Transaction txn = MakeTxn(3000);
+  DeleteRequest request;
+  DeleteResponse response;
+  request.set_path("/r/a");
+  request.set_version(-1);
+  tree.Delete(request, &txn, &response);
+  Check(response.code() == RC_CHILDREN_EXISTS,
+        "the delete without recursive fails");
+  request.set_recursive(true);
+  tree.Delete(request, &txn, &response);
+  Check(response.code() == RC_OK, "the recursive delete is applied");
+  std::string data;
+  Check(GetData(&tree, "/r/a/b/c", &data) == RC_NO_NODE &&
+            GetData(&tree, "/r/a", &data) == RC_NO_NODE,
+        "the subtree is deleted");
+  Check(ChildrenSize(&tree, "/r") == 0, "the parent has no child");
+
+  for (size_t i = 1; i < 5; ++i) {
+    Check(recorder.Count(paths[i], ET_NODE_DELETED) == 1,
+          "every node fires one deleted event");
+  }
+  const char* parents[] = {"/r", "/r/a", "/r/a/b"};
+  for (const char* parent : parents) {
+    Check(recorder.Count(parent, ET_NODE_CHILDREN_CHANGED) == 1,
+          "every parent fires one children changed event");
+  }
+  Check(recorder.Count("/r/a/b/c", ET_NODE_CHILDREN_CHANGED) == 0 &&
+            recorder.Count("/r/a/d", ET_NODE_CHILDREN_CHANGED) == 0,
+        "the leaves fire no children changed event");
+  Check(recorder.Find("/r/a/b/c", ET_NODE_DELETED) <
+                recorder.Find("/r/a/b", ET_NODE_CHILDREN_CHANGED) &&
+            recorder.Find("/r/a/b", ET_NODE_CHILDREN_CHANGED) <
+                recorder.Find("/r/a/b", ET_NODE_DELETED) &&
+            recorder.Find("/r/a/b", ET_NODE_DELETED) <
+                recorder.Find("/r/a", ET_NODE_CHILDREN_CHANGED) &&
+            recorder.Find("/r/a", ET_NODE_DELETED) <
+                recorder.Find("/r", ET_NODE_CHILDREN_CHANGED),
+        "the events of the children come before the ones of the parent");
+}
+
+static ResponseCode Increment(DataTree* tree, const std::string& path,
+                              int64_t delta, int64_t* value) {
+  Transaction txn = MakeTxn(4000);
+  IncrementRequest request;
+  IncrementResponse response;
+  request.set_path(path);
+  request.set_delta(delta);
+  tree->Increment(request, &txn, &response);
+  *value = response.value();
+  return response.code();
+}
+
+static void TestIncrement() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/i", "");
+  Create(&tree, "/s", "abc");
+  Create(&tree, "/max", "9223372036854775807");
+  int64_t value = 0;
+  std::string data;
+  Check(Increment(&tree, "/i", 5, &value) == RC_OK && value == 5 &&
+            Increment(&tree, "/i", -7, &value) == RC_OK && value == -2,
+        "the empty data is zero");
+  Check(GetData(&tree, "/i", &data) == RC_OK && data == "-2",
+        "the value is kept as a decimal string");
+  Check(Increment(&tree, "/s", 1, &value) == RC_BAD_DATA &&
+            GetData(&tree, "/s", &data) == RC_OK && data == "abc",
+        "the non-numeric data is rejected and kept");
+  Check(Increment(&tree, "/max", 1, &value) == RC_BAD_DATA &&
+            GetData(&tree, "/max", &data) == RC_OK &&
+            data == "9223372036854775807",
+        "the overflow is rejected");
+  Check(Increment(&tree, "/missing", 1, &value) == RC_NO_NODE,
+        "the node must exist");
+}
+
+static ResponseCode SetData(DataTree* tree, const std::string& path,
+                            const std::string& data, SetDataMode mode,
+                            uint32_t offset = 0) {
+  Transaction txn = MakeTxn(5000);
+  SetDataRequest request;
+  SetDataResponse response;
+  request.set_path(path);
+  request.set_data(data);
+  request.set_version(-1);
+  request.set_mode(mode);
+  request.set_offset(offset);
+  tree->SetData(request, &txn, &response);
+  return response.code();
+}
+
+static void TestSetDataModes() {
+  DataTree tree(16);
+  Create(&tree, "/d", "hello");
+  std::string data;
+  Check(SetData(&tree, "/d", " world", SM_APPEND) == RC_OK &&
+            GetData(&tree, "/d", &data) == RC_OK && data == "hello world",
+        "the data is appended");
+  Check(SetData(&tree, "/d", "WORLD!", SM_PATCH, 6) == RC_OK &&
+            GetData(&tree, "/d", &data) == RC_OK && data == "hello WORLD!",
+        "the data is patched and extended");
+  Check(SetData(&tree, "/d", "x", SM_PATCH, 13) == RC_BAD_DATA &&
+            GetData(&tree, "/d", &data) == RC_OK && data == "hello WORLD!",
+        "the patch past the end is rejected");
+
+  Check(SetData(&tree, "/d", "12345", SM_APPEND) == RC_BAD_DATA &&
+            SetData(&tree, "/d", "12345", SM_PATCH, 12) == RC_BAD_DATA,
+        "the data over the max size is rejected when applied");
+  MultiRequest request;
+  MultiOp* op = request.add_ops();
+  op->set_type(MT_SETDATA);
+  op->mutable_set_data()->set_path("/d");
+  op->mutable_set_data()->set_version(-1);
+  op->mutable_set_data()->set_mode(SM_APPEND);
+  op->mutable_set_data()->set_data("12345");
+  Transaction txn = MakeTxn(5001);
+  MultiResponse response;
+  tree.Multi(request, &txn, &response);
+  Check(response.code() == RC_BAD_DATA &&
+            GetData(&tree, "/d", &data) == RC_OK && data == "hello WORLD!",
+        "the append of Multi over the max size is rejected");
+}
+
+static void TestMultiGetDataLimit() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/g", "");
+  Create(&tree, "/g/a", std::string(60, 'a'));
+  Create(&tree, "/g/b", std::string(60, 'b'));
+  EventRecorder watcher;
+
+  MultiGetDataRequest request;
+  GetDataRequest* r = request.add_requests();
+  r->set_path("/g/a");
+  r->set_watch(true);
+  r = request.add_requests();
+  r->set_path("/g/b");
+  r->set_watch(true);
+  r = request.add_requests();
+  r->set_path("/g/missing");
+
+  MultiGetDataResponse response;
+  tree.MultiGetData(request, 100, &watcher, &response);
+  Check(response.code() == RC_TOO_LARGE && response.responses_size() == 0,
+        "the reads over the budget fail");
+  SetData(&tree, "/g/a", "x", SM_REPLACE);
+  Check(watcher.events.empty(), "no watch is set by the failed reads");
+
+  // Only the bytes of a ranged read are counted.
+  request.mutable_requests(1)->set_max_size(10);
+  response.Clear();
+  tree.MultiGetData(request, 100, &watcher, &response);
+  Check(response.code() == RC_OK && response.responses_size() == 3 &&
+            response.responses(0).data() == "x" &&
+            response.responses(1).data() == std::string(10, 'b') &&
+            response.responses(2).code() == RC_NO_NODE,
+        "the reads within the budget are done");
+}
+
+static void TestChildrenPaging() {
+  DataTree tree(kMaxDataSize);
+  Create(&tree, "/c", "");
+  const char* names[] = {"a1", "a2", "a3", "b1", "b2"};
+  for (const char* name : names) {
+    Create(&tree, std::string("/c/") + name, std::string(10, name[0]));
+  }
+
+  GetChildrenRequest request;
+  GetChildrenResponse response;
+  request.set_path("/c");
+  request.set_max_children(2);
+  tree.GetChildren(request, nullptr, &response);
+  Check(response.children_size() == 2 && response.children(0) == "a1" &&
+            response.next_start_after() == "a2",
+        "the first page");
+  request.set_start_after(response.next_start_after());
+  response.Clear();
+  tree.GetChildren(request, nullptr, &response);
+  Check(response.children_size() == 2 && response.children(0) == "a3" &&
+            response.next_start_after() == "b1",
+        "the next page");
+  request.set_start_after("b1");
+  response.Clear();
+  tree.GetChildren(request, nullptr, &response);
+  Check(response.children_size() == 1 && response.children(0) == "b2" &&
+            response.next_start_after().empty(),
+        "the last page");
+
+  request.Clear();
+  request.set_path("/c");
+  request.set_prefix("a");
+  request.set_max_children(2);
+  response.Clear();
+  tree.GetChildren(request, nullptr, &response);
+  Check(response.children_size() == 2 && response.next_start_after() == "a2",
+        "the page of a prefix");
+  request.set_start_after("a2");
+  response.Clear();
+  tree.GetChildren(request, nullptr, &response);
+  Check(response.children_size() == 1 && response.children(0) == "a3" &&
+            response.next_start_after().empty(),
+        "the prefix ends the pages");
+
+  request.Clear();
+  request.set_path("/c");
+  request.set_with_nodes(true);
+  request.set_max_data_size(25);
+  response.Clear();
+  tree.GetChildren(request, nullptr, &response);
+  Check(response.nodes_size() == 2 &&
+            response.nodes(1).data() == std::string(10, 'a') &&
+            response.next_start_after() == "a2",
+        "the page ends before the data budget");
+}
+
+int main() {
+  TestMultiRollback();
+  TestMultiCheckEphemeral();
+  TestSubtreeLimits();
+  TestWalkSubtree();
+  TestRecursiveDelete();
+  TestIncrement();
+  TestSetDataModes();
+  TestMultiGetDataLimit();
+  TestChildrenPaging();
+  if (failures == 0) {
+    printf("data_tree_test passed.\n");
+  }
+  return failures == 0 ? 0 : 1;
+}
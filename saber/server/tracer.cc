@@ -0,0 +1,185 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/server/tracer.h"
+
+#include <stdio.h>
+
+#include <random>
+
+#include "saber/util/logging.h"
+#include "saber/util/timeops.h"
+
+namespace saber {
+
+static std::mt19937_64& Random() {
+  static thread_local std::mt19937_64 random(std::random_device{}());
+  return random;
+}
+
+Trace::Trace() { Reset(0, kSession, MT_PING, 0, 0); }
+
+void Trace::Reset(uint64_t id, Hop h, MessageType t, uint32_t group,
+                  uint64_t session) {
+  trace_id = id;
+  hop = h;
+  type = t;
+  group_id = group;
+  session_id = session;
+  for (int i = 0; i < kPointSize; ++i) {
+    points[i] = 0;
+  }
+}
+
+Tracer::Tracer(const ServerOptions& options)
+    : sample_rate_(options.trace_sample_rate),
+      capacity_(options.trace_buffer_size),
+      slow_micros_(static_cast<uint64_t>(options.slow_request_time) * 1000),
+      slow_logs_per_second_(options.slow_request_logs_per_second),
+      next_(0),
+      slow_second_(0),
+      slow_logs_(0),
+      slow_suppressed_(0) {}
+
+Tracer::~Tracer() {}
+
+uint64_t Tracer::Sample() {
+  if (sample_rate_ <= 0 || capacity_ == 0) {
+    return 0;
+  }
+  std::uniform_real_distribution<double> dist(0.0, 1.0);
+  if (dist(Random()) >= sample_rate_) {
+    return 0;
+  }
+  uint64_t id = 0;
+  while (id == 0) {
+    id = Random()();
+  }
+  return id;
+}
+
+void Tracer::Add(const Trace& trace) {
+  if (capacity_ == 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (traces_.size() < capacity_) {
+    traces_.push_back(trace);
+  } else {
+    traces_[next_] = trace;
+  }
+  next_ = (next_ + 1) % capacity_;
+}
+
+void Tracer::Finish(const Trace& trace, const std::string& path) {
+  if (trace.trace_id != 0) {
+    Add(trace);
+  }
+  if (slow_micros_ == 0 || trace.points[Trace::kReceived] == 0) {
+    return;
+  }
+  uint64_t micros =
+      trace.points[Trace::kReplied] - trace.points[Trace::kReceived];
+  if (micros >= slow_micros_) {
+    LogSlowRequest(trace, path, micros);
+  }
+}
+
+void Tracer::LogSlowRequest(const Trace& trace, const std::string& path,
+                            uint64_t micros) {
+  uint64_t suppressed = 0;
+  {
+    std::lock_guard<std::mutex> lock(slow_mutex_);
+    uint64_t second = NowMillis() / 1000;
+    if (second != slow_second_) {
+      slow_second_ = second;
+      slow_logs_ = 0;
+    }
+    if (slow_logs_ >= slow_logs_per_second_) {
+      ++slow_suppressed_;
+      return;
+    }
+    ++slow_logs_;
+    suppressed = slow_suppressed_;
+    slow_suppressed_ = 0;
+  }
+
+  const uint64_t* p = trace.points;
+  uint64_t queue = p[Trace::kStarted] - p[Trace::kReceived];
+  uint64_t check = p[Trace::kChecked] ? p[Trace::kChecked] - p[Trace::kStarted]
+                                      : 0;
+  uint64_t apply = p[Trace::kExecuted] - p[Trace::kExecuting];
+  uint64_t propose = 0;
+  uint64_t last = p[Trace::kChecked] ? p[Trace::kChecked] : p[Trace::kStarted];
+  if (p[Trace::kCommitted]) {
+    propose = p[Trace::kCommitted] - p[Trace::kProposed] - apply;
+    last = p[Trace::kCommitted];
+  }
+  uint64_t send = p[Trace::kReplied] - last;
+  LOG_WARN(
+      "Slow request: type:%s, path:%s, session:%llu, group:%u, total:%llu, "
+      "queue:%llu, check:%llu, propose:%llu, apply:%llu, send:%llu (us), "
+      "%llu suppressed.",
+      MessageType_Name(trace.type).c_str(), path.c_str(),
+      (unsigned long long)trace.session_id, trace.group_id,
+      (unsigned long long)micros, (unsigned long long)queue,
+      (unsigned long long)check, (unsigned long long)propose,
+      (unsigned long long)apply, (unsigned long long)send,
+      (unsigned long long)suppressed);
+}
+
+const char* Tracer::PointName(Trace::Point point) {
+  static const char* kPointNames[] = {"received",  "started",  "checked",
+                                      "proposed",  "executing", "executed",
+                                      "committed", "replied"};
+  return kPointNames[point];
+}
+
+void Tracer::AppendJson(std::string* out) const {
+  std::vector<Trace> traces;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (traces_.size() < capacity_) {
+      traces = traces_;
+    } else {
+      traces.assign(traces_.begin() + next_, traces_.end());
+      traces.insert(traces.end(), traces_.begin(), traces_.begin() + next_);
+    }
+  }
+
+  char buf[256];
+  out->push_back('[');
+  for (size_t i = 0; i < traces.size(); ++i) {
+    const Trace& trace = traces[i];
+    uint64_t start = 0;
+    for (int j = 0; j < Trace::kPointSize; ++j) {
+      if (trace.points[j] != 0) {
+        start = trace.points[j];
+        break;
+      }
+    }
+    snprintf(buf, sizeof(buf),
+             "%s{\"trace_id\":\"%016llx\",\"hop\":\"%s\",\"type\":\"%s\","
+             "\"group_id\":%u,\"session_id\":%llu,\"start\":%llu",
+             i == 0 ? "" : ",", (unsigned long long)trace.trace_id,
+             trace.hop == Trace::kSession ? "session" : "execute",
+             MessageType_Name(trace.type).c_str(), trace.group_id,
+             (unsigned long long)trace.session_id,
+             (unsigned long long)start);
+    out->append(buf);
+    // The other points are the offsets from the start.
+    for (int j = 0; j < Trace::kPointSize; ++j) {
+      if (trace.points[j] != 0) {
+        snprintf(buf, sizeof(buf), ",\"%s\":%llu",
+                 PointName(static_cast<Trace::Point>(j)),
+                 (unsigned long long)(trace.points[j] - start));
+        out->append(buf);
+      }
+    }
+    out->push_back('}');
+  }
+  out->push_back(']');
+}
+
+}  // namespace saber
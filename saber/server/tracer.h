@@ -0,0 +1,98 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_SERVER_TRACER_H_
+#define SABER_SERVER_TRACER_H_
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "saber/proto/saber.pb.h"
+#include "saber/server/server_options.h"
+
+namespace saber {
+
+// The timestamps (in microseconds) of a traced message at one hop. The
+// session hop is recorded by the SaberSession which received the message,
+// the execute hop is recorded by every server which applies it, so the same
+// trace id may be found on all servers.
+struct Trace {
+  enum Hop { kSession = 0, kExecute = 1 };
+
+  enum Point {
+    kReceived = 0,
+    kStarted = 1,
+    kChecked = 2,
+    kProposed = 3,
+    kExecuting = 4,
+    kExecuted = 5,
+    kCommitted = 6,
+    kReplied = 7,
+    kPointSize = 8
+  };
+
+  uint64_t trace_id;
+  Hop hop;
+  MessageType type;
+  uint32_t group_id;
+  uint64_t session_id;
+  // Zero if the message didn't reach the point.
+  uint64_t points[kPointSize];
+
+  Trace();
+  void Reset(uint64_t id, Hop h, MessageType t, uint32_t group,
+             uint64_t session);
+};
+
+// Keep the last traces in a ring buffer, and log the slow requests.
+class Tracer {
+ public:
+  explicit Tracer(const ServerOptions& options);
+  ~Tracer();
+
+  // Return a new trace id if the message is sampled, otherwise return 0.
+  // The messages which already carry a trace id are always traced.
+  uint64_t Sample();
+
+  void Add(const Trace& trace);
+
+  // Called when the session hop of every message is finished. The trace is
+  // kept if it has a trace id, and logged if it is slower than
+  // ServerOptions::slow_request_time.
+  void Finish(const Trace& trace, const std::string& path);
+
+  // Append the traces as a JSON array, the oldest first.
+  void AppendJson(std::string* out) const;
+
+  static const char* PointName(Trace::Point point);
+
+ private:
+  void LogSlowRequest(const Trace& trace, const std::string& path,
+                      uint64_t micros);
+
+  const double sample_rate_;
+  const size_t capacity_;
+  const uint64_t slow_micros_;
+  const uint32_t slow_logs_per_second_;
+
+  mutable std::mutex mutex_;
+  std::vector<Trace> traces_;
+  size_t next_;
+
+  std::mutex slow_mutex_;
+  uint64_t slow_second_;
+  uint32_t slow_logs_;
+  uint64_t slow_suppressed_;
+
+  // No copying allowed
+  Tracer(const Tracer&);
+  void operator=(const Tracer&);
+};
+
+}  // namespace saber
+
+#endif  // SABER_SERVER_TRACER_H_
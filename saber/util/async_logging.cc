@@ -0,0 +1,367 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/util/async_logging.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "saber/util/logging.h"
+
+namespace saber {
+
+AsyncLoggingOptions::AsyncLoggingOptions()
+    : max_file_size(64 * 1024 * 1024),
+      thread_buffer_size(1024),
+      max_record_size(512),
+      flush_interval(100) {}
+
+namespace {
+
+// Single producer (the owner thread) and single consumer (the flush thread).
+class RingBuffer {
+ public:
+  RingBuffer(uint32_t capacity, uint32_t record_size)
+      : retired(false),
+        capacity_(capacity),
+        record_size_(record_size),
+        head_(0),
+        tail_(0),
+        records_(new char[static_cast<size_t>(capacity) * record_size]),
+        lengths_(new uint32_t[capacity]) {}
+
+  char* Reserve() {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= capacity_) {
+      return nullptr;
+    }
+    return &records_[(tail % capacity_) * record_size_];
+  }
+
+  // Return the number of the records buffered.
+  uint64_t Commit(uint32_t length) {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    lengths_[tail % capacity_] = length;
+    tail_.store(tail + 1, std::memory_order_release);
+    return tail + 1 - head_.load(std::memory_order_acquire);
+  }
+
+  bool Drain(std::string* out) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    uint64_t tail = tail_.load(std::memory_order_acquire);
+    for (; head < tail; ++head) {
+      size_t i = head % capacity_;
+      out->append(&records_[i * record_size_], lengths_[i]);
+    }
+    head_.store(head, std::memory_order_release);
+    return head == tail_.load(std::memory_order_acquire);
+  }
+
+  uint32_t capacity() const { return capacity_; }
+  uint32_t record_size() const { return record_size_; }
+
+  // Set when the owner thread exits or the logging stops, the buffer will
+  // be released after it has been drained.
+  std::atomic<bool> retired;
+
+ private:
+  const uint32_t capacity_;
+  const uint32_t record_size_;
+  std::atomic<uint64_t> head_;
+  std::atomic<uint64_t> tail_;
+  std::unique_ptr<char[]> records_;
+  std::unique_ptr<uint32_t[]> lengths_;
+
+  // No copying allowed
+  RingBuffer(const RingBuffer&);
+  void operator=(const RingBuffer&);
+};
+
+struct ThreadBuffer {
+  ~ThreadBuffer() {
+    if (ring) {
+      ring->retired = true;
+    }
+  }
+  std::shared_ptr<RingBuffer> ring;
+  time_t last_second = 0;
+  char time_prefix[64];
+};
+
+thread_local ThreadBuffer tls_buffer;
+
+// Never deleted, since the producers may still be running in the handler
+// when the logging stops.
+struct AsyncLogger {
+  AsyncLoggingOptions options;
+  // Guards the state and the rings, it is never held while writing, so the
+  // first record of a thread doesn't wait for the disk.
+  std::mutex mutex;
+  // Guards the file. It is taken before mutex is released, so the records
+  // are written in the order they are drained.
+  std::mutex write_mutex;
+  std::condition_variable cond;
+  bool running = false;
+  bool stop = false;
+  // Set by a thread whose ring is half full, to flush before the interval.
+  std::atomic<bool> wakeup{false};
+  std::vector<std::shared_ptr<RingBuffer>> rings;
+  std::atomic<uint64_t> dropped{0};
+  uint64_t reported_dropped = 0;
+  std::unique_ptr<std::thread> thread;
+  FILE* file = nullptr;
+  uint64_t file_size = 0;
+  LogHandler* old_handler = nullptr;
+};
+
+AsyncLogger* logger_ = new AsyncLogger();
+
+const char* kLoglevelNames[] = {"DEBUG", "INFO", "WARN", "ERROR", "FATAL"};
+
+size_t FormatRecord(LogLevel level, const char* filename, int line,
+                    const char* format, va_list ap, char* base,
+                    size_t size) {
+  struct timeval now_tv;
+  gettimeofday(&now_tv, nullptr);
+  if (now_tv.tv_sec != tls_buffer.last_second) {
+    const time_t seconds = now_tv.tv_sec;
+    struct tm t;
+    localtime_r(&seconds, &t);
+    snprintf(tls_buffer.time_prefix, sizeof(tls_buffer.time_prefix),
+             "%04d/%02d/%02d-%02d:%02d:%02d", t.tm_year + 1900, t.tm_mon + 1,
+             t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec);
+    tls_buffer.last_second = seconds;
+  }
+
+  // Keep one byte for the trailing newline.
+  size_t limit = size - 1;
+  int n = snprintf(base, limit, "[%s.%06d][%s %s:%d] ",
+                   tls_buffer.time_prefix, static_cast<int>(now_tv.tv_usec),
+                   kLoglevelNames[level], filename, line);
+  size_t p = n > 0 ? static_cast<size_t>(n) : 0;
+  if (p < limit) {
+    va_list backup_ap;
+    va_copy(backup_ap, ap);
+    n = vsnprintf(base + p, limit - p, format, backup_ap);
+    va_end(backup_ap);
+    p += n > 0 ? static_cast<size_t>(n) : 0;
+  }
+  if (p >= limit) {
+    p = limit - 1;
+  }
+  base[p++] = '\n';
+  return p;
+}
+
+// The files of a process opened in the same second are told apart by it.
+uint32_t file_sequence = 0;
+
+void OpenFile() {
+  if (logger_->options.basename.empty()) {
+    logger_->file = stderr;
+  } else {
+    struct timeval now_tv;
+    gettimeofday(&now_tv, nullptr);
+    const time_t seconds = now_tv.tv_sec;
+    struct tm t;
+    localtime_r(&seconds, &t);
+    char suffix[80];
+    snprintf(suffix, sizeof(suffix), ".%04d%02d%02d-%02d%02d%02d.%d.%u.log",
+             t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min,
+             t.tm_sec, static_cast<int>(getpid()), file_sequence++);
+    logger_->file = fopen((logger_->options.basename + suffix).c_str(), "a");
+  }
+  logger_->file_size = 0;
+}
+
+void CloseFile() {
+  if (logger_->file != nullptr && logger_->file != stderr) {
+    fclose(logger_->file);
+  }
+  logger_->file = nullptr;
+}
+
+// REQUIRES: logger_->write_mutex held.
+void WriteLocked(const std::string& s) {
+  if (s.empty() || logger_->file == nullptr) {
+    return;
+  }
+  fwrite(s.data(), 1, s.size(), logger_->file);
+  fflush(logger_->file);
+  logger_->file_size += s.size();
+  if (logger_->file != stderr &&
+      logger_->file_size >= logger_->options.max_file_size) {
+    CloseFile();
+    OpenFile();
+  }
+}
+
+// REQUIRES: logger_->mutex held.
+void DrainLocked(std::string* out) {
+  auto& rings = logger_->rings;
+  for (size_t i = 0; i < rings.size();) {
+    // Loaded before the drain, so the last record committed before the
+    // owner thread retires the ring is drained too.
+    bool retired = rings[i]->retired.load(std::memory_order_acquire);
+    bool empty = rings[i]->Drain(out);
+    if (empty && retired) {
+      rings[i] = rings.back();
+      rings.pop_back();
+    } else {
+      ++i;
+    }
+  }
+  uint64_t dropped = logger_->dropped.load(std::memory_order_relaxed);
+  if (dropped != logger_->reported_dropped) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "[async logging dropped %llu records]\n",
+             (unsigned long long)(dropped - logger_->reported_dropped));
+    out->append(buf);
+    logger_->reported_dropped = dropped;
+  }
+}
+
+void FlushThreadFunc() {
+  std::string buffer;
+  std::unique_lock<std::mutex> lock(logger_->mutex);
+  while (!logger_->stop) {
+    logger_->cond.wait_for(
+        lock, std::chrono::milliseconds(logger_->options.flush_interval),
+        []() { return logger_->stop || logger_->wakeup.load(); });
+    logger_->wakeup = false;
+    DrainLocked(&buffer);
+    {
+      std::lock_guard<std::mutex> write_lock(logger_->write_mutex);
+      lock.unlock();
+      WriteLocked(buffer);
+    }
+    buffer.clear();
+    lock.lock();
+  }
+}
+
+// Set wakeup under the mutex, so the flush thread can't miss it between
+// checking it and waiting.
+void WakeFlusher() {
+  if (logger_->wakeup.load(std::memory_order_relaxed) ||
+      logger_->wakeup.exchange(true)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(logger_->mutex);
+  logger_->cond.notify_one();
+}
+
+std::shared_ptr<RingBuffer> NewThreadRing() {
+  std::lock_guard<std::mutex> lock(logger_->mutex);
+  auto ring = std::make_shared<RingBuffer>(logger_->options.thread_buffer_size,
+                                           logger_->options.max_record_size);
+  logger_->rings.push_back(ring);
+  return ring;
+}
+
+void AsyncLogHandler(LogLevel level, const char* filename, int line,
+                     const char* format, va_list ap) {
+  if (level == LOGLEVEL_FATAL) {
+    char buffer[30000];
+    size_t size = FormatRecord(level, filename, line, format, ap, buffer,
+                               sizeof(buffer));
+    std::string s;
+    {
+      std::lock_guard<std::mutex> lock(logger_->mutex);
+      std::lock_guard<std::mutex> write_lock(logger_->write_mutex);
+      DrainLocked(&s);
+      s.append(buffer, size);
+      WriteLocked(s);
+    }
+    abort();
+  }
+
+  std::shared_ptr<RingBuffer>& ring = tls_buffer.ring;
+  if (!ring || ring->retired) {
+    ring = NewThreadRing();
+  }
+  char* record = ring->Reserve();
+  if (record == nullptr) {
+    // Give the woken flush thread one chance to run (such as on a single
+    // core), before dropping the record.
+    WakeFlusher();
+    std::this_thread::yield();
+    record = ring->Reserve();
+    if (record == nullptr) {
+      logger_->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  size_t size = FormatRecord(level, filename, line, format, ap, record,
+                             ring->record_size());
+  if (ring->Commit(static_cast<uint32_t>(size)) >= ring->capacity() / 2) {
+    WakeFlusher();
+  }
+}
+
+}  // anonymous namespace
+
+bool StartAsyncLogging(const AsyncLoggingOptions& options) {
+  assert(options.thread_buffer_size > 0);
+  assert(options.max_record_size > 64);
+  {
+    std::lock_guard<std::mutex> lock(logger_->mutex);
+    if (logger_->running) {
+      return false;
+    }
+    logger_->options = options;
+    OpenFile();
+    if (logger_->file == nullptr) {
+      return false;
+    }
+    logger_->running = true;
+    logger_->stop = false;
+  }
+  logger_->thread.reset(new std::thread(&FlushThreadFunc));
+  logger_->old_handler = SetLogHandler(&AsyncLogHandler);
+  return true;
+}
+
+void StopAsyncLogging() {
+  {
+    std::lock_guard<std::mutex> lock(logger_->mutex);
+    if (!logger_->running || logger_->stop) {
+      return;
+    }
+    SetLogHandler(logger_->old_handler);
+    logger_->stop = true;
+    logger_->cond.notify_one();
+  }
+  logger_->thread->join();
+  logger_->thread.reset();
+
+  std::lock_guard<std::mutex> lock(logger_->mutex);
+  std::lock_guard<std::mutex> write_lock(logger_->write_mutex);
+  std::string buffer;
+  for (auto& ring : logger_->rings) {
+    ring->retired = true;
+  }
+  DrainLocked(&buffer);
+  WriteLocked(buffer);
+  CloseFile();
+  logger_->running = false;
+}
+
+uint64_t AsyncLoggingDroppedCount() {
+  return logger_->dropped.load(std::memory_order_relaxed);
+}
+
+}  // namespace saber
@@ -0,0 +1,54 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_UTIL_ASYNC_LOGGING_H_
+#define SABER_UTIL_ASYNC_LOGGING_H_
+
+#include <stdint.h>
+
+#include <string>
+
+namespace saber {
+
+struct AsyncLoggingOptions {
+  // The log files are named as basename.YYYYmmdd-HHMMSS.pid.seq.log, where
+  // seq counts the files opened by the process, a new one is opened when
+  // the current one has grown up to max_file_size.
+  // Default: "" (write to stderr)
+  std::string basename;
+
+  // Default: 64MB
+  uint64_t max_file_size;
+
+  // The number of records each thread can buffer. The background thread is
+  // woken up when a buffer is half full, and the new records are dropped
+  // if it is still full after the thread yields once.
+  // Default: 1024
+  uint32_t thread_buffer_size;
+
+  // The longer records will be truncated.
+  // Default: 512
+  uint32_t max_record_size;
+
+  // Default: 100ms
+  uint32_t flush_interval;
+
+  AsyncLoggingOptions();
+};
+
+// Replace the log handler with one which only formats the record into
+// a lock-free ring buffer owned by the calling thread, a background thread
+// drains the buffers and writes them out. The FATAL records are still
+// written synchronously before abort.
+extern bool StartAsyncLogging(const AsyncLoggingOptions& options);
+
+// Flush all buffered records and restore the previous log handler.
+extern void StopAsyncLogging();
+
+// The number of records dropped because the buffers were full.
+extern uint64_t AsyncLoggingDroppedCount();
+
+}  // namespace saber
+
+#endif  // SABER_UTIL_ASYNC_LOGGING_H_
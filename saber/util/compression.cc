@@ -0,0 +1,220 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/util/compression.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <utility>
+
+#include "saber/proto/saber.pb.h"
+
+namespace saber {
+
+namespace {
+
+const size_t kMinMatch = 4;
+const size_t kMaxOffset = 65535;
+const int kHashBits = 12;
+
+inline uint32_t Load32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Hash(uint32_t v) {
+  return (v * 2654435761U) >> (32 - kHashBits);
+}
+
+void PutVarint32(uint32_t v, std::string* output) {
+  while (v >= 128) {
+    output->push_back(static_cast<char>(v | 128));
+    v >>= 7;
+  }
+  output->push_back(static_cast<char>(v));
+}
+
+bool GetVarint32(const char** p, const char* limit, uint32_t* v) {
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28 && *p < limit; shift += 7) {
+    uint32_t byte = static_cast<unsigned char>(*((*p)++));
+    result |= (byte & 127) << shift;
+    if (byte < 128) {
+      *v = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+// The part of a length over 15 in the token.
+void PutLength(size_t length, std::string* output) {
+  while (length >= 255) {
+    output->push_back(static_cast<char>(255));
+    length -= 255;
+  }
+  output->push_back(static_cast<char>(length));
+}
+
+bool GetLength(const char** p, const char* limit, size_t* length) {
+  unsigned char byte;
+  do {
+    if (*p >= limit) {
+      return false;
+    }
+    byte = static_cast<unsigned char>(*((*p)++));
+    *length += byte;
+  } while (byte == 255);
+  return true;
+}
+
+// The match_length is zero for the last sequence.
+void PutSequence(const char* literals, size_t literal_length, size_t offset,
+                 size_t match_length, std::string* output) {
+  size_t m = match_length > 0 ? match_length - kMinMatch : 0;
+  unsigned char token = static_cast<unsigned char>(
+      ((literal_length < 15 ? literal_length : 15) << 4) | (m < 15 ? m : 15));
+  output->push_back(static_cast<char>(token));
+  if (literal_length >= 15) {
+    PutLength(literal_length - 15, output);
+  }
+  output->append(literals, literal_length);
+  if (match_length > 0) {
+    output->push_back(static_cast<char>(offset & 255));
+    output->push_back(static_cast<char>(offset >> 8));
+    if (m >= 15) {
+      PutLength(m - 15, output);
+    }
+  }
+}
+
+}  // anonymous namespace
+
+bool Compress(const char* input, size_t size, std::string* output) {
+  output->clear();
+  if (size < 16 || size > UINT32_MAX) {
+    return false;
+  }
+  PutVarint32(static_cast<uint32_t>(size), output);
+
+  // The positions plus one of the last 4 bytes with every hash.
+  uint32_t table[1 << kHashBits];
+  memset(table, 0, sizeof(table));
+  size_t anchor = 0;
+  size_t i = 0;
+  while (i + kMinMatch <= size) {
+    uint32_t v = Load32(input + i);
+    uint32_t h = Hash(v);
+    size_t candidate = table[h];
+    table[h] = static_cast<uint32_t>(i + 1);
+    if (candidate == 0 || i - (candidate - 1) > kMaxOffset ||
+        Load32(input + candidate - 1) != v) {
+      ++i;
+      continue;
+    }
+    size_t match = candidate - 1;
+    size_t length = kMinMatch;
+    while (i + length < size && input[match + length] == input[i + length]) {
+      ++length;
+    }
+    PutSequence(input + anchor, i - anchor, i - match, length, output);
+    i += length;
+    anchor = i;
+    if (output->size() >= size) {
+      return false;
+    }
+  }
+  PutSequence(input + anchor, size - anchor, 0, 0, output);
+  return output->size() < size;
+}
+
+bool Uncompress(const char* input, size_t size, size_t max_size,
+                std::string* output) {
+  output->clear();
+  const char* p = input;
+  const char* limit = input + size;
+  uint32_t expected;
+  // A byte of input can't produce more than 255 bytes of output.
+  if (!GetVarint32(&p, limit, &expected) || expected > max_size ||
+      expected / 255 > size) {
+    return false;
+  }
+  output->resize(expected);
+  char* base = &(*output)[0];
+  size_t n = 0;
+  while (p < limit) {
+    unsigned char token = static_cast<unsigned char>(*p++);
+    size_t literal_length = token >> 4;
+    if (literal_length == 15 && !GetLength(&p, limit, &literal_length)) {
+      return false;
+    }
+    if (literal_length > static_cast<size_t>(limit - p) ||
+        literal_length > expected - n) {
+      return false;
+    }
+    memcpy(base + n, p, literal_length);
+    n += literal_length;
+    p += literal_length;
+    if (p == limit) {
+      break;
+    }
+
+    if (limit - p < 2) {
+      return false;
+    }
+    size_t offset = static_cast<unsigned char>(p[0]) |
+                    (static_cast<size_t>(static_cast<unsigned char>(p[1]))
+                     << 8);
+    p += 2;
+    size_t match_length = token & 15;
+    if (match_length == 15 && !GetLength(&p, limit, &match_length)) {
+      return false;
+    }
+    match_length += kMinMatch;
+    if (offset == 0 || offset > n || match_length > expected - n) {
+      return false;
+    }
+    if (offset >= match_length) {
+      memcpy(base + n, base + n - offset, match_length);
+    } else {
+      // The match overlaps the bytes it produces.
+      for (size_t i = 0; i < match_length; ++i) {
+        base[n + i] = base[n - offset + i];
+      }
+    }
+    n += match_length;
+  }
+  return n == expected;
+}
+
+bool CompressMessage(uint32_t threshold, SaberMessage* message) {
+  if (threshold == 0 || message->data().size() < threshold) {
+    return false;
+  }
+  std::string data;
+  if (!Compress(message->data().data(), message->data().size(), &data)) {
+    return false;
+  }
+  message->set_data(std::move(data));
+  message->set_compressed(true);
+  return true;
+}
+
+bool UncompressMessage(size_t max_size, SaberMessage* message) {
+  if (!message->compressed()) {
+    return true;
+  }
+  std::string data;
+  if (!Uncompress(message->data().data(), message->data().size(), max_size,
+                  &data)) {
+    return false;
+  }
+  message->set_data(std::move(data));
+  message->set_compressed(false);
+  return true;
+}
+
+}  // namespace saber
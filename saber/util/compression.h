@@ -0,0 +1,45 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_UTIL_COMPRESSION_H_
+#define SABER_UTIL_COMPRESSION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace saber {
+
+// A fast LZ77 codec in the style of LZ4, built in so that every replica
+// can read the data compressed by any other one. The output starts with
+// the varint32 of the uncompressed size, followed by the sequences of a
+// token (the literal length in the high 4 bits and the match length minus
+// 4 in the low 4 bits, 15 means that more bytes follow), the literals and
+// a 2 bytes little-endian offset of the match. The last sequence has only
+// the literals. The output is deterministic for the same input.
+
+// Return false (and leave *output unspecified) if it isn't worth it, that
+// is the output wouldn't be smaller than the input.
+bool Compress(const char* input, size_t size, std::string* output);
+
+// Return false if the input is corrupted, or its uncompressed size is over
+// max_size, which is checked before anything is allocated, since a small
+// untrusted input may claim a huge size.
+bool Uncompress(const char* input, size_t size, size_t max_size,
+                std::string* output);
+
+class SaberMessage;
+
+// Compress the data of the message in place if it is at least the threshold
+// (zero means never) and gets smaller. Return true if it is compressed.
+bool CompressMessage(uint32_t threshold, SaberMessage* message);
+
+// Uncompress the data of the message in place if it is compressed. Return
+// false if the data is corrupted or would be over max_size.
+bool UncompressMessage(size_t max_size, SaberMessage* message);
+
+}  // namespace saber
+
+#endif  // SABER_UTIL_COMPRESSION_H_
@@ -0,0 +1,120 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "saber/util/histogram.h"
+
+#include <stdio.h>
+
+namespace saber {
+
+Histogram::Histogram() { Clear(); }
+
+int Histogram::BucketIndex(uint64_t value) {
+  if (value < kSubBucketSize) {
+    return static_cast<int>(value);
+  }
+  int msb = 63 - __builtin_clzll(value);
+  int shift = msb - kSubBucketBits;
+  int sub = static_cast<int>((value >> shift) & (kSubBucketSize - 1));
+  return ((shift + 1) << kSubBucketBits) + sub;
+}
+
+uint64_t Histogram::BucketLimit(int index) {
+  if (index < kSubBucketSize) {
+    return static_cast<uint64_t>(index);
+  }
+  int shift = (index >> kSubBucketBits) - 1;
+  uint64_t sub = static_cast<uint64_t>(index & (kSubBucketSize - 1));
+  uint64_t low = (kSubBucketSize + sub) << shift;
+  return low + ((static_cast<uint64_t>(1) << shift) - 1);
+}
+
+void Histogram::Add(uint64_t value) {
+  buckets_[BucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t old = min_.load(std::memory_order_relaxed);
+  while (value < old &&
+         !min_.compare_exchange_weak(old, value, std::memory_order_relaxed)) {
+  }
+  old = max_.load(std::memory_order_relaxed);
+  while (value > old &&
+         !max_.compare_exchange_weak(old, value, std::memory_order_relaxed)) {
+  }
+}
+
+void Histogram::Merge(const Histogram& other) {
+  uint64_t n = other.count();
+  if (n == 0) {
+    return;
+  }
+  for (int i = 0; i < kBucketSize; ++i) {
+    uint64_t b = other.buckets_[i].load(std::memory_order_relaxed);
+    if (b > 0) {
+      buckets_[i].fetch_add(b, std::memory_order_relaxed);
+    }
+  }
+  count_.fetch_add(n, std::memory_order_relaxed);
+  sum_.fetch_add(other.sum(), std::memory_order_relaxed);
+  uint64_t v = other.min_.load(std::memory_order_relaxed);
+  if (v < min_.load(std::memory_order_relaxed)) {
+    min_.store(v, std::memory_order_relaxed);
+  }
+  v = other.max();
+  if (v > max()) {
+    max_.store(v, std::memory_order_relaxed);
+  }
+}
+
+void Histogram::Clear() {
+  count_ = 0;
+  sum_ = 0;
+  min_ = UINT64_MAX;
+  max_ = 0;
+  for (int i = 0; i < kBucketSize; ++i) {
+    buckets_[i] = 0;
+  }
+}
+
+uint64_t Histogram::min() const {
+  return count() == 0 ? 0 : min_.load(std::memory_order_relaxed);
+}
+
+double Histogram::Average() const {
+  uint64_t n = count();
+  return n == 0 ? 0.0 : static_cast<double>(sum()) / static_cast<double>(n);
+}
+
+uint64_t Histogram::Percentile(double p) const {
+  uint64_t n = count();
+  if (n == 0) {
+    return 0;
+  }
+  double threshold = static_cast<double>(n) * p / 100.0;
+  uint64_t cumulative = 0;
+  for (int i = 0; i < kBucketSize; ++i) {
+    cumulative += buckets_[i].load(std::memory_order_relaxed);
+    if (static_cast<double>(cumulative) >= threshold) {
+      uint64_t limit = BucketLimit(i);
+      // The bucket's limit may be beyond the really recorded values.
+      return limit < max() ? (limit > min() ? limit : min()) : max();
+    }
+  }
+  return max();
+}
+
+std::string Histogram::ToString() const {
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "count=%llu avg=%.1f min=%llu p50=%llu p90=%llu p99=%llu "
+           "p999=%llu max=%llu",
+           (unsigned long long)count(), Average(), (unsigned long long)min(),
+           (unsigned long long)Percentile(50),
+           (unsigned long long)Percentile(90),
+           (unsigned long long)Percentile(99),
+           (unsigned long long)Percentile(99.9), (unsigned long long)max());
+  return buf;
+}
+
+}  // namespace saber
@@ -0,0 +1,62 @@
+// Copyright (c) 2017 Mirants Lu. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef SABER_UTIL_HISTOGRAM_H_
+#define SABER_UTIL_HISTOGRAM_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+namespace saber {
+
+// A log-linear histogram in the style of HdrHistogram. Every power of two
+// range is split into 2^kSubBucketBits buckets, so the recorded values keep
+// kSubBucketBits significant bits (the relative error is below 12.5%).
+// Add() is lock-free and can be called concurrently, the readers should
+// Merge() it into a private histogram first.
+class Histogram {
+ public:
+  static const int kSubBucketBits = 3;
+  static const int kSubBucketSize = 1 << kSubBucketBits;
+  static const int kBucketSize = (64 - kSubBucketBits + 1) * kSubBucketSize;
+
+  Histogram();
+
+  void Add(uint64_t value);
+  void Merge(const Histogram& other);
+  void Clear();
+
+  uint64_t count() const { return count_.load(std::memory_order_relaxed); }
+  uint64_t sum() const { return sum_.load(std::memory_order_relaxed); }
+  uint64_t min() const;
+  uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+  double Average() const;
+
+  // p is between [0, 100].
+  uint64_t Percentile(double p) const;
+
+  // Such as "count=10 avg=12.5 min=3 p50=11 p90=20 p99=31 p999=31 max=31".
+  std::string ToString() const;
+
+ private:
+  static int BucketIndex(uint64_t value);
+  static uint64_t BucketLimit(int index);
+
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> min_;
+  std::atomic<uint64_t> max_;
+  std::atomic<uint64_t> buckets_[kBucketSize];
+
+  // No copying allowed
+  Histogram(const Histogram&);
+  void operator=(const Histogram&);
+};
+
+}  // namespace saber
+
+#endif  // SABER_UTIL_HISTOGRAM_H_
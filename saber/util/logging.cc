@@ -76,28 +76,31 @@ void DefaultLogHandler(LogLevel level, const char* filename, int line,
   }
 }
 
-static LogHandler* log_handler_ = &DefaultLogHandler;
-static LogLevel log_level_ = LOGLEVEL_DEBUG;
+namespace internal {
+LogHandler* log_handler = &DefaultLogHandler;
+LogLevel log_level = LOGLEVEL_DEBUG;
+}  // namespace internal
 
 void Log(LogLevel level, const char* filename, int line, const char* format,
          ...) {
-  if (log_handler_ != nullptr && level >= log_level_) {
+  LogHandler* handler = internal::log_handler;
+  if (handler != nullptr && level >= internal::log_level) {
     va_list ap;
     va_start(ap, format);
-    log_handler_(level, filename, line, format, ap);
+    handler(level, filename, line, format, ap);
     va_end(ap);
   }
 }
 
 LogHandler* SetLogHandler(LogHandler* new_handler) {
-  LogHandler* old_handler = log_handler_;
-  log_handler_ = new_handler;
+  LogHandler* old_handler = internal::log_handler;
+  internal::log_handler = new_handler;
   return old_handler;
 }
 
 LogLevel SetLogLevel(LogLevel new_level) {
-  LogLevel old_level = log_level_;
-  log_level_ = new_level;
+  LogLevel old_level = internal::log_level;
+  internal::log_level = new_level;
   return old_level;
 }
 
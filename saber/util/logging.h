@@ -18,6 +18,20 @@ enum LogLevel {
   LOGLEVEL_FATAL
 };
 
+typedef void LogHandler(LogLevel level, const char* filename, int line,
+                        const char* format, va_list ap);
+
+namespace internal {
+extern LogHandler* log_handler;
+extern LogLevel log_level;
+}  // namespace internal
+
+// Checked by the LOG_* macros before the arguments are evaluated, so the
+// disabled levels cost only a comparison.
+inline bool IsLogEnabled(LogLevel level) {
+  return internal::log_handler != nullptr && level >= internal::log_level;
+}
+
 extern void Log(LogLevel level, const char* filename, int line,
                 const char* format, ...)
 #if defined(__GNUC__) || defined(__clang__)
@@ -25,32 +39,31 @@ extern void Log(LogLevel level, const char* filename, int line,
 #endif
     ;
 
-#define LOG_DEBUG(format, ...)                                      \
-  ::saber::Log(::saber::LOGLEVEL_DEBUG, __FILE__, __LINE__, format, \
-               ##__VA_ARGS__)
+#define SABER_LOG(level, format, ...)                                 \
+  do {                                                                \
+    if (::saber::IsLogEnabled(level)) {                               \
+      ::saber::Log(level, __FILE__, __LINE__, format, ##__VA_ARGS__); \
+    }                                                                 \
+  } while (0)
 
-#define LOG_INFO(format, ...)                                      \
-  ::saber::Log(::saber::LOGLEVEL_INFO, __FILE__, __LINE__, format, \
-               ##__VA_ARGS__)
+#define LOG_DEBUG(format, ...) \
+  SABER_LOG(::saber::LOGLEVEL_DEBUG, format, ##__VA_ARGS__)
 
-#define LOG_WARN(format, ...)                                      \
-  ::saber::Log(::saber::LOGLEVEL_WARN, __FILE__, __LINE__, format, \
-               ##__VA_ARGS__)
+#define LOG_INFO(format, ...) \
+  SABER_LOG(::saber::LOGLEVEL_INFO, format, ##__VA_ARGS__)
 
-#define LOG_ERROR(format, ...)                                      \
-  ::saber::Log(::saber::LOGLEVEL_ERROR, __FILE__, __LINE__, format, \
-               ##__VA_ARGS__)
+#define LOG_WARN(format, ...) \
+  SABER_LOG(::saber::LOGLEVEL_WARN, format, ##__VA_ARGS__)
 
-#define LOG_FATAL(format, ...)                                      \
-  ::saber::Log(::saber::LOGLEVEL_FATAL, __FILE__, __LINE__, format, \
-               ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) \
+  SABER_LOG(::saber::LOGLEVEL_ERROR, format, ##__VA_ARGS__)
+
+#define LOG_FATAL(format, ...) \
+  SABER_LOG(::saber::LOGLEVEL_FATAL, format, ##__VA_ARGS__)
 
 extern void DefaultLogHandler(LogLevel level, const char* filename, int line,
                               const char* format, va_list ap);
 
-typedef void LogHandler(LogLevel level, const char* filename, int line,
-                        const char* format, va_list ap);
-
 extern LogHandler* SetLogHandler(LogHandler* new_handler);
 
 extern LogLevel SetLogLevel(LogLevel new_level);
@@ -0,0 +1,135 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "saber/util/async_logging.h"
+#include "saber/util/logging.h"
+#include "saber/util/timeops.h"
+
+using namespace saber;
+
+static const int kThreads = 4;
+static const int kRecords = 10000;
+
+static int Evaluated() {
+  static int i = 0;
+  return ++i;
+}
+
+// Read the lines of all the files in the dir, and remove them.
+static std::vector<std::string> ReadLines(const std::string& dir) {
+  std::vector<std::string> lines;
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return lines;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(d)) != nullptr) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    std::string file = dir + "/" + entry->d_name;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+      lines.push_back(line);
+    }
+    unlink(file.c_str());
+  }
+  closedir(d);
+  return lines;
+}
+
+int main() {
+  SetLogLevel(LOGLEVEL_INFO);
+  LOG_DEBUG("never evaluated: %d", Evaluated());
+  if (Evaluated() != 1) {
+    printf("the disabled arguments were evaluated!\n");
+    return 1;
+  }
+
+  char dir[] = "/tmp/async_logging_test.XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    printf("mkdtemp failed!\n");
+    return 1;
+  }
+  AsyncLoggingOptions options;
+  options.basename = std::string(dir) + "/test";
+  if (!StartAsyncLogging(options)) {
+    printf("StartAsyncLogging failed!\n");
+    return 1;
+  }
+
+  uint64_t start = NowMicros();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kThreads; ++i) {
+    threads.push_back(std::thread([i]() {
+      for (int j = 0; j < kRecords; ++j) {
+        LOG_INFO("thread %d record %d", i, j);
+      }
+    }));
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  uint64_t end = NowMicros();
+
+  // The rings of the exited threads are drained by the flush thread.
+  std::this_thread::sleep_for(
+      std::chrono::milliseconds(options.flush_interval * 3));
+  uint64_t dropped = AsyncLoggingDroppedCount();
+  StopAsyncLogging();
+
+  std::vector<std::string> lines = ReadLines(dir);
+  rmdir(dir);
+  printf("%d records in %llu us, dropped %llu\n", kThreads * kRecords,
+         (unsigned long long)(end - start), (unsigned long long)dropped);
+
+  int failures = 0;
+  uint64_t reported = 0;
+  uint64_t records = 0;
+  std::vector<int> last(kThreads, -1);
+  for (const auto& line : lines) {
+    unsigned long long n;
+    int i;
+    int j;
+    if (sscanf(line.c_str(), "[async logging dropped %llu records]", &n) ==
+        1) {
+      reported += n;
+      continue;
+    }
+    const char* p = strstr(line.c_str(), "] thread ");
+    if (p == nullptr || sscanf(p, "] thread %d record %d", &i, &j) != 2 ||
+        i < 0 || i >= kThreads) {
+      printf("unexpected line: %s\n", line.c_str());
+      ++failures;
+      continue;
+    }
+    if (j <= last[i]) {
+      printf("thread %d: record %d after %d!\n", i, j, last[i]);
+      ++failures;
+    }
+    last[i] = j;
+    ++records;
+  }
+  if (reported != dropped) {
+    printf("reported %llu dropped records, but counted %llu!\n",
+           (unsigned long long)reported, (unsigned long long)dropped);
+    ++failures;
+  }
+  if (records + dropped != static_cast<uint64_t>(kThreads * kRecords)) {
+    printf("%llu records written and %llu dropped, of %d!\n",
+           (unsigned long long)records, (unsigned long long)dropped,
+           kThreads * kRecords);
+    ++failures;
+  }
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+
+#include "saber/proto/saber.pb.h"
+#include "saber/util/compression.h"
+#include "saber/util/timeops.h"
+
+using namespace saber;
+
+static bool RoundTrip(const std::string& name, const std::string& data) {
+  std::string compressed;
+  std::string uncompressed;
+  uint64_t start = NowMicros();
+  if (!Compress(data.data(), data.size(), &compressed)) {
+    printf("%s: %zu bytes, not compressed\n", name.c_str(), data.size());
+    return true;
+  }
+  uint64_t middle = NowMicros();
+  if (!Uncompress(compressed.data(), compressed.size(), data.size(),
+                  &uncompressed) ||
+      uncompressed != data) {
+    printf("%s: round trip failed!\n", name.c_str());
+    return false;
+  }
+  uint64_t end = NowMicros();
+  printf("%s: %zu -> %zu bytes, compress %llu us, uncompress %llu us\n",
+         name.c_str(), data.size(), compressed.size(),
+         (unsigned long long)(middle - start),
+         (unsigned long long)(end - middle));
+
+  // A truncated input is rejected, unless only the empty last sequence is
+  // cut off.
+  for (size_t i = 0; i < compressed.size(); ++i) {
+    if (Uncompress(compressed.data(), i, data.size(), &uncompressed) &&
+        uncompressed != data) {
+      printf("%s: truncated input at %zu accepted!\n", name.c_str(), i);
+      return false;
+    }
+  }
+  return true;
+}
+
+// A small input claiming a huge size is rejected by the max size.
+static bool HugeSize() {
+  std::string bomb;
+  for (uint32_t v = 1024 * 1024 * 1024; v >= 128; v >>= 7) {
+    bomb.push_back(static_cast<char>(v | 128));
+  }
+  bomb.push_back(static_cast<char>(4));
+  bomb.append(8 * 1024 * 1024, static_cast<char>(255));
+  std::string output;
+  if (Uncompress(bomb.data(), bomb.size(), 1024 * 1024, &output)) {
+    printf("huge: accepted over the max size!\n");
+    return false;
+  }
+  return true;
+}
+
+static bool MessageRoundTrip(const std::string& data) {
+  SaberMessage message;
+  message.set_type(MT_GETDATA);
+  message.set_id(7);
+  message.set_data(data);
+  if (CompressMessage(0, &message) ||
+      CompressMessage(static_cast<uint32_t>(data.size() + 1), &message)) {
+    printf("message: compressed below the threshold!\n");
+    return false;
+  }
+  if (!CompressMessage(static_cast<uint32_t>(data.size()), &message) ||
+      !message.compressed() || message.data().size() >= data.size()) {
+    printf("message: not compressed!\n");
+    return false;
+  }
+  if (UncompressMessage(data.size() - 1, &message) ||
+      !message.compressed()) {
+    printf("message: over the max size accepted!\n");
+    return false;
+  }
+  if (!UncompressMessage(data.size(), &message) || message.compressed() ||
+      message.data() != data || message.id() != 7) {
+    printf("message: round trip failed!\n");
+    return false;
+  }
+  message.set_data("garbage");
+  message.set_compressed(true);
+  if (UncompressMessage(data.size(), &message)) {
+    printf("message: corrupted data accepted!\n");
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  std::string json;
+  for (int i = 0; i < 2000; ++i) {
+    json += "{\"host\":\"10.0.0." + std::to_string(i % 256) +
+            "\",\"port\":" + std::to_string(8000 + i % 16) +
+            ",\"weight\":100,\"tags\":[\"rack-a\",\"zone-1\"]},";
+  }
+  std::string random;
+  srand(1);
+  for (int i = 0; i < 100000; ++i) {
+    random.push_back(static_cast<char>(rand()));
+  }
+  std::string run(100000, 'a');
+
+  bool ok = RoundTrip("json", json) && RoundTrip("random", random) &&
+            RoundTrip("run", run) &&
+            RoundTrip("short", "abcdabcdabcdabcdabcd") &&
+            HugeSize() && MessageRoundTrip(json);
+  return ok ? 0 : 1;
+}